@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include "definitions.h"
 // #include "credentials.h"
 
 // VARIABLES
@@ -23,6 +24,7 @@ int RESET_COUNTER = 0;
 float CURRENT_TEMPERATURE = -1;
 float CURRENT_HUMIDITY = -1;
 float CURRENT_PROBE_TEMPERATURE = -1;
+float PROBE_TEMPERATURES[MAX_PROBES] = {-1, -1, -1, -1};
 
 bool IS_HEAT_MAT_ON = false;
 bool IS_FAN_ON = false;
@@ -31,6 +31,12 @@ extern float CURRENT_HUMIDITY;
 
 extern float CURRENT_PROBE_TEMPERATURE;
 
+constexpr int MAX_PROBES = 4;
+/**
+ * Every DS18B20 probe's temperature, CURRENT_PROBE_TEMPERATURE is the first one
+ */
+extern float PROBE_TEMPERATURES[MAX_PROBES];
+
 extern bool IS_HEAT_MAT_ON;
 extern bool IS_FAN_ON;
 extern float LED_LEVEL;
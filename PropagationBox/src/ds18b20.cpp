@@ -1,34 +1,156 @@
 #include <Arduino.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
-#include "definitions.h"
-#include "interval_timer.h"
+#include "job_scheduler.h"
+#include "ds18b20.h"
 
-static OneWire ds(DS18B20_PIN);
-static Timer timer(30000);
+constexpr uint32_t DS18B20_FAILURES_BEFORE_DISCOVERY = 3;
+/**
+ * How often an empty bus is searched again
+ */
+constexpr unsigned long DS18B20_DISCOVERY_RETRY_MS = 60 * 1000;
 
-// Setup a oneWire instance to communicate with any OneWire devices (not just Maxim/Dallas temperature ICs)
-OneWire oneWire(DS18B20_PIN);
+enum Ds18b20State : uint8_t
+{
+    DS18B20_DISCOVER,
+    DS18B20_IDLE,
+    DS18B20_CONVERTING,
+};
+
+static OneWire *oneWire = nullptr;
+static DallasTemperature *sensors = nullptr;
+static DeviceAddress ADDRESSES[DS18B20_MAX_PROBES];
+static int probeCount = 0;
 
-// Pass our oneWire reference to Dallas Temperature.
-DallasTemperature sensors(&oneWire);
+static Ds18b20State state = DS18B20_DISCOVER;
+static int ds18b20Job = NO_JOB;
+static unsigned long readIntervalMs = 0;
+static Ds18b20ReadingCallback readingCallback = nullptr;
+static unsigned long conversionStartMs = 0;
+static uint32_t conversionStartUs = 0;
+static Ds18b20Stats stats = {};
 
-int count = 0;
+static void countBusTime(uint32_t start)
+{
+    stats.maxBusUs = max(stats.maxBusUs, static_cast<uint32_t>(micros() - start));
+}
 
-void temperatureProbeSetup(void)
+/**
+ * Search the bus and remember the address of each probe so reads don't have to search again
+ */
+static void discoverProbes()
 {
-    Serial.println("Setup temperature probe...");
-    sensors.begin();
+    stats.discoveries++;
+    uint32_t start = micros();
+    sensors->begin();
+    // the job waits out the conversion instead of the library
+    sensors->setWaitForConversion(false);
+    probeCount = 0;
+    int found = min<int>(sensors->getDeviceCount(), DS18B20_MAX_PROBES);
+    for (int i = 0; i < found; i++)
+    {
+        if (sensors->getAddress(ADDRESSES[probeCount], i))
+        {
+            probeCount++;
+        }
+    }
+    countBusTime(start);
+    stats.probes = probeCount;
+}
+
+static void startConversion()
+{
+    uint32_t start = micros();
+    sensors->requestTemperatures();
+    countBusTime(start);
+    conversionStartMs = millis();
+    conversionStartUs = micros();
+    stats.conversions++;
+    state = DS18B20_CONVERTING;
+    scheduleJob(ds18b20Job, sensors->millisToWaitForConversion());
+}
+
+/**
+ * Returns false once the probe has failed enough reads in a row that the bus should be
+ * searched again
+ */
+static bool readProbe(int probe)
+{
+    uint32_t start = micros();
+    float temperature = sensors->getTempC(ADDRESSES[probe]);
+    countBusTime(start);
+
+    Ds18b20ProbeStats &probeStats = stats.probe[probe];
+    if (temperature == DEVICE_DISCONNECTED_C)
+    {
+        probeStats.failures++;
+        probeStats.consecutiveFailures++;
+        if (probeStats.consecutiveFailures < DS18B20_FAILURES_BEFORE_DISCOVERY)
+        {
+            return true;
+        }
+        readingCallback(probe, false, 0);
+        probeStats.consecutiveFailures = 0;
+        return false;
+    }
+    probeStats.reads++;
+    probeStats.consecutiveFailures = 0;
+    readingCallback(probe, true, temperature);
+    return true;
 }
 
-void temperatureProbeLoop(void)
+static void collectConversion()
 {
-    if (!timer.isIntervalPassed())
+    bool allFound = true;
+    for (int i = 0; i < probeCount; i++)
     {
+        allFound &= readProbe(i);
+    }
+    uint32_t latency = micros() - conversionStartUs;
+    stats.lastLatencyUs = latency;
+    stats.maxLatencyUs = max(stats.maxLatencyUs, latency);
+    state = allFound ? DS18B20_IDLE : DS18B20_DISCOVER;
+
+    // keep the interval between conversions rather than between results
+    unsigned long elapsed = millis() - conversionStartMs;
+    scheduleJob(ds18b20Job, elapsed < readIntervalMs ? readIntervalMs - elapsed : 0);
+}
+
+/**
+ * Each run does one step and schedules the next one
+ */
+static void ds18b20Step()
+{
+    switch (state)
+    {
+    case DS18B20_DISCOVER:
+        discoverProbes();
+        if (probeCount == 0)
+        {
+            scheduleJob(ds18b20Job, DS18B20_DISCOVERY_RETRY_MS);
+            return;
+        }
+        startConversion();
+        return;
+    case DS18B20_IDLE:
+        startConversion();
+        return;
+    case DS18B20_CONVERTING:
+        collectConversion();
         return;
     }
-    Serial.println("Checking temperature probe...");
-    sensors.requestTemperatures(); // Send the command to get temperatures
-    CURRENT_PROBE_TEMPERATURE = sensors.getTempCByIndex(0);
-    Serial.println("Temperature: " + String(CURRENT_PROBE_TEMPERATURE));
+}
+
+void ds18b20Setup(uint8_t pin, unsigned long intervalMs, Ds18b20ReadingCallback callback)
+{
+    readIntervalMs = intervalMs;
+    readingCallback = callback;
+    oneWire = new OneWire(pin);
+    sensors = new DallasTemperature(oneWire);
+    ds18b20Job = addOneShotJob("ds18b20", ds18b20Step, 0);
+}
+
+Ds18b20Stats getDs18b20Stats()
+{
+    return stats;
 }
@@ -0,0 +1,369 @@
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "job_scheduler.h"
+
+/**
+ * One wheel turn is 256ms, anything due later than that waits in its slot for later turns
+ */
+constexpr uint32_t JOB_WHEEL_SLOTS = 256;
+
+struct Job
+{
+    const char *name;
+    JobCallback callback;
+    /**
+     * 0 for a one shot job
+     */
+    uint32_t intervalMs;
+    /**
+     * When the job should run, lateness is measured from here
+     */
+    uint32_t deadline;
+    /**
+     * Millisecond whose slot the job is in, the deadline unless that had already been walked past
+     */
+    uint32_t slotTick;
+    /**
+     * Next job in the same slot, or NO_JOB
+     */
+    int8_t next;
+    bool scheduled;
+    JobStats stats;
+};
+
+static Job JOBS[MAX_JOBS];
+static int jobCount = 0;
+static int8_t WHEEL[JOB_WHEEL_SLOTS];
+static bool wheelInitialized = false;
+static int scheduledCount = 0;
+
+/**
+ * Every slot up to and including this millisecond has been walked
+ */
+static uint32_t lastTick = 0;
+
+static SemaphoreHandle_t wakeSemaphore = nullptr;
+
+static JobSchedulerStats schedulerStats = {};
+static uint64_t asleepUs = 0;
+static uint32_t firstRunUs = 0;
+static uint64_t runningUs = 0;
+static uint32_t lastRunUs = 0;
+
+/**
+ * micros() of the first wake since the loop last woke up, 0 when there is none
+ */
+static volatile uint32_t wakeRequestedUs = 0;
+
+/**
+ * a is before b, safe across millis() wrapping
+ */
+static bool isBefore(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+static void initializeWheel()
+{
+    if (wheelInitialized)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < JOB_WHEEL_SLOTS; i++)
+    {
+        WHEEL[i] = NO_JOB;
+    }
+    lastTick = millis() - 1;
+    wakeSemaphore = xSemaphoreCreateBinary();
+    wheelInitialized = true;
+}
+
+static void insertJob(int job, uint32_t deadline)
+{
+    Job &entry = JOBS[job];
+    entry.deadline = deadline;
+    // a slot that has already been walked won't be looked at until the wheel comes around again
+    entry.slotTick = isBefore(lastTick, deadline) ? deadline : lastTick + 1;
+    int8_t &head = WHEEL[entry.slotTick % JOB_WHEEL_SLOTS];
+    entry.next = head;
+    head = job;
+    entry.scheduled = true;
+    scheduledCount++;
+}
+
+static void removeJob(int job)
+{
+    Job &entry = JOBS[job];
+    if (!entry.scheduled)
+    {
+        return;
+    }
+    int8_t *link = &WHEEL[entry.slotTick % JOB_WHEEL_SLOTS];
+    while (*link != NO_JOB && *link != job)
+    {
+        link = &JOBS[*link].next;
+    }
+    if (*link == job)
+    {
+        *link = entry.next;
+    }
+    entry.next = NO_JOB;
+    entry.scheduled = false;
+    scheduledCount--;
+}
+
+static int addJob(const char *name, JobCallback callback, uint32_t intervalMs, uint32_t delayMs)
+{
+    initializeWheel();
+    if (jobCount >= MAX_JOBS)
+    {
+        return NO_JOB;
+    }
+    int job = jobCount++;
+    JOBS[job] = {name, callback, intervalMs, 0, 0, NO_JOB, false, {}};
+    insertJob(job, millis() + delayMs);
+    return job;
+}
+
+int addPeriodicJob(const char *name, unsigned long intervalMs, JobCallback callback, unsigned long firstDelayMs)
+{
+    return addJob(name, callback, intervalMs > 0 ? intervalMs : 1, firstDelayMs);
+}
+
+int addOneShotJob(const char *name, JobCallback callback, unsigned long delayMs)
+{
+    return addJob(name, callback, 0, delayMs);
+}
+
+void scheduleJob(int job, unsigned long delayMs)
+{
+    if (job < 0 || job >= jobCount)
+    {
+        return;
+    }
+    removeJob(job);
+    insertJob(job, millis() + delayMs);
+}
+
+/**
+ * Milliseconds until the earliest scheduled job, capped at maxSleepMs
+ */
+static uint32_t msUntilNextJob(uint32_t now, uint32_t maxSleepMs)
+{
+    if (scheduledCount == 0)
+    {
+        return maxSleepMs;
+    }
+
+    uint32_t next = 0;
+    bool found = false;
+    // a job in the coming turn of the wheel is in the first slot that holds a job for that tick
+    for (uint32_t tick = lastTick + 1; tick != lastTick + 1 + JOB_WHEEL_SLOTS && !found; tick++)
+    {
+        for (int8_t job = WHEEL[tick % JOB_WHEEL_SLOTS]; job != NO_JOB; job = JOBS[job].next)
+        {
+            if (JOBS[job].slotTick == tick)
+            {
+                next = tick;
+                found = true;
+                break;
+            }
+        }
+    }
+    if (!found)
+    {
+        // everything is at least a turn away, there are few enough jobs to just look at them all
+        for (int job = 0; job < jobCount; job++)
+        {
+            if (JOBS[job].scheduled && (!found || isBefore(JOBS[job].slotTick, next)))
+            {
+                next = JOBS[job].slotTick;
+                found = true;
+            }
+        }
+    }
+
+    if (!isBefore(now, next))
+    {
+        return 0;
+    }
+    return min(next - now, maxSleepMs);
+}
+
+/**
+ * Take every job that is due out of the wheel, walking only the slots of the milliseconds
+ * that passed. Returns how many were put in due, earliest deadline first.
+ */
+static int takeDueJobs(uint32_t now, int (&due)[MAX_JOBS])
+{
+    int count = 0;
+    uint32_t ticks = now - lastTick;
+    if (ticks > JOB_WHEEL_SLOTS)
+    {
+        ticks = JOB_WHEEL_SLOTS;
+    }
+    for (uint32_t i = 1; i <= ticks; i++)
+    {
+        int8_t job = WHEEL[(lastTick + i) % JOB_WHEEL_SLOTS];
+        while (job != NO_JOB)
+        {
+            int8_t next = JOBS[job].next;
+            if (!isBefore(now, JOBS[job].slotTick))
+            {
+                removeJob(job);
+                int at = count++;
+                while (at > 0 && isBefore(JOBS[job].deadline, JOBS[due[at - 1]].deadline))
+                {
+                    due[at] = due[at - 1];
+                    at--;
+                }
+                due[at] = job;
+            }
+            job = next;
+        }
+    }
+    lastTick = now;
+    return count;
+}
+
+static void runJob(int job)
+{
+    uint32_t now = millis();
+    Job &entry = JOBS[job];
+    JobStats &stats = entry.stats;
+    uint32_t late = isBefore(entry.deadline, now) ? now - entry.deadline : 0;
+    stats.lastLateMs = late;
+    stats.maxLateMs = max(stats.maxLateMs, late);
+    stats.totalLateMs += late;
+
+    // reschedule before running so the callback can move its own next run
+    if (entry.intervalMs > 0)
+    {
+        uint32_t deadline = entry.deadline + entry.intervalMs;
+        if (!isBefore(now, deadline))
+        {
+            uint32_t missed = (now - deadline) / entry.intervalMs + 1;
+            stats.overruns += missed;
+            deadline += missed * entry.intervalMs;
+        }
+        insertJob(job, deadline);
+    }
+
+    unsigned long start = micros();
+    entry.callback();
+    uint32_t duration = micros() - start;
+    stats.lastRunUs = duration;
+    stats.maxRunUs = max(stats.maxRunUs, duration);
+    stats.runs++;
+}
+
+/**
+ * Wait for the next deadline or a wake and count how long that took
+ */
+static void sleepUntilWoken(uint32_t sleepMs)
+{
+    uint32_t start = micros();
+    if (firstRunUs == 0)
+    {
+        firstRunUs = start;
+        lastRunUs = start;
+    }
+    bool woken = xSemaphoreTake(wakeSemaphore, pdMS_TO_TICKS(sleepMs)) == pdTRUE;
+    uint32_t end = micros();
+
+    asleepUs += end - start;
+    schedulerStats.sleeps++;
+    if (woken)
+    {
+        schedulerStats.eventWakes++;
+        uint32_t requested = wakeRequestedUs;
+        // a wake from before the sleep started was waiting on the awake part of the pass
+        if (requested != 0)
+        {
+            uint32_t latency = end - requested;
+            schedulerStats.lastWakeLatencyUs = latency;
+            schedulerStats.maxWakeLatencyUs = max(schedulerStats.maxWakeLatencyUs, latency);
+        }
+    }
+    wakeRequestedUs = 0;
+
+    runningUs += end - lastRunUs;
+    lastRunUs = end;
+    schedulerStats.asleepMs = asleepUs / 1000;
+    schedulerStats.awakeMs = (runningUs - asleepUs) / 1000;
+}
+
+void runJobScheduler(unsigned long maxSleepMs)
+{
+    initializeWheel();
+    uint32_t sleepMs = msUntilNextJob(millis(), maxSleepMs);
+    if (sleepMs > 0)
+    {
+        sleepUntilWoken(sleepMs);
+    }
+
+    int due[MAX_JOBS];
+    int count = takeDueJobs(millis(), due);
+    for (int i = 0; i < count; i++)
+    {
+        runJob(due[i]);
+    }
+}
+
+static void IRAM_ATTR markWakeRequested()
+{
+    if (wakeRequestedUs == 0)
+    {
+        uint32_t now = micros();
+        wakeRequestedUs = now != 0 ? now : 1;
+    }
+}
+
+void wakeJobScheduler()
+{
+    if (wakeSemaphore != nullptr)
+    {
+        markWakeRequested();
+        xSemaphoreGive(wakeSemaphore);
+    }
+}
+
+void IRAM_ATTR wakeJobSchedulerFromISR()
+{
+    if (wakeSemaphore != nullptr)
+    {
+        markWakeRequested();
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        xSemaphoreGiveFromISR(wakeSemaphore, &higherPriorityTaskWoken);
+        if (higherPriorityTaskWoken)
+        {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+int getJobCount()
+{
+    return jobCount;
+}
+
+const char *getJobName(int job)
+{
+    return JOBS[job].name;
+}
+
+unsigned long getJobInterval(int job)
+{
+    return JOBS[job].intervalMs;
+}
+
+JobStats getJobStats(int job)
+{
+    return JOBS[job].stats;
+}
+
+JobSchedulerStats getJobSchedulerStats()
+{
+    return schedulerStats;
+}
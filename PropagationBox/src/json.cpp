@@ -34,3 +34,18 @@ String buildJson(std::map<String, String> data)
     json += "}";
     return json;
 }
+
+String buildJsonOfJson(std::map<String, String> data)
+{
+    String json = "{";
+    for (auto const &entry : data)
+    {
+        json += "\"" + escapeString(entry.first) + "\":" + entry.second + ",";
+    }
+    if (data.size() > 0)
+    {
+        json = json.substring(0, json.length() - 1);
+    }
+    json += "}";
+    return json;
+}
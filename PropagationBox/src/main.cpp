@@ -1,7 +1,7 @@
 #include <Arduino.h>
 // #include "credentials.h"
 #include "definitions.h"
-#include "ds18b20.h"
+#include "temperatureProbe.h"
 #include "temperatureMoisture.h"
 #include "device_identity.h"
 #include "servers.h"
@@ -10,16 +10,21 @@
 #include "peripheral_controls.h"
 #include "time_helpers.h"
 #include "pwm_led.h"
+#include "job_scheduler.h"
+#include "power_management.h"
 
 // look into: https://github.com/kj831ca/KasaSmartPlug
 
+// The web server is polled, waiting this long between polls lets the cpu idle at its lowest clock
+constexpr unsigned long SERVER_POLL_MS = 10;
+
 void serverTask(void *parameter)
 {
   serverSetup();
   for (;;)
   {
     serverLoop();
-    delay(1);
+    delay(SERVER_POLL_MS);
   }
 }
 
@@ -27,9 +32,12 @@ void setup(void)
 {
   Serial.begin(BAUD);
   delay(200);
+  powerManagementSetup();
   setupPreferences();
   checkDeviceIdentityOnSetup();
   wifiSetup();
+  timeSetup();
+  temperatureMoistureSetup();
   xTaskCreatePinnedToCore(
       serverTask,   /* Function to implement the task */
       "serverTask", /* Name of the task */
@@ -45,12 +53,10 @@ void setup(void)
   Serial.println("~~~ SETUP FINISHED ~~~");
 }
 
+/**
+ * Sleeps until the next job is due, the jobs are registered by each module's setup
+ */
 void loop()
 {
-  wifiCheckInLoop();
-  updateTimeLoop();
-  temperatureMoistureLoop();
-  temperatureProbeLoop();
-  controlPeripheralsLoop();
-  delay(100);
+  runJobScheduler();
 }
@@ -1,11 +1,12 @@
 #include <Arduino.h>
 #include <time.h>
 #include "definitions.h"
-#include "interval_timer.h"
+#include "job_scheduler.h"
+#include "peripheral_controls.h"
 #include "time_helpers.h"
 #include "pwm_led.h"
 
-static Timer timer(30000);
+constexpr unsigned long PERIPHERAL_CONTROL_INTERVAL_MS = 30000;
 
 void turnOffFan()
 {
@@ -43,6 +44,7 @@ void peripheralControlsSetup()
     pinMode(FAN_PIN, OUTPUT);
     pinMode(HEAT_MAT_PIN, OUTPUT);
     turnOffAllPeripherals();
+    addPeriodicJob("peripherals", PERIPHERAL_CONTROL_INTERVAL_MS, controlPeripheralsLoop);
 }
 
 /**
@@ -50,11 +52,6 @@ void peripheralControlsSetup()
  */
 void controlPeripheralsLoop()
 {
-    if (!timer.isIntervalPassed())
-    {
-        return;
-    }
-
     Serial.println("Checking peripherals...");
 
     // 1: if the temperature is too high outside of the variance we need to turn off the heat mat
@@ -0,0 +1,54 @@
+#include <Arduino.h>
+#include <esp_pm.h>
+#include "power_management.h"
+#include "job_scheduler.h"
+
+constexpr uint32_t MAX_CPU_FREQ_MHZ = 240;
+// the lowest frequency that keeps the APB clock, and with it the uart, wifi and ledc, at 80MHz
+constexpr uint32_t MIN_CPU_FREQ_MHZ = 80;
+
+// ESP32 datasheet, modem sleep (cpu running, radio off) currents
+constexpr float ACTIVE_CURRENT_MA = 50;
+constexpr float IDLE_CURRENT_MA = 30;
+constexpr float IDLE_SCALED_CURRENT_MA = 20;
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+typedef esp_pm_config_esp32s3_t PowerConfig;
+#else
+typedef esp_pm_config_esp32_t PowerConfig;
+#endif
+
+static bool frequencyScaling = false;
+
+void powerManagementSetup()
+{
+    PowerConfig config = {};
+    config.max_freq_mhz = MAX_CPU_FREQ_MHZ;
+    config.min_freq_mhz = MIN_CPU_FREQ_MHZ;
+    config.light_sleep_enable = false;
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK)
+    {
+        Serial.println("Power management unavailable: " + String(esp_err_to_name(err)));
+        return;
+    }
+    frequencyScaling = true;
+    Serial.println("Power management on, " + String(MIN_CPU_FREQ_MHZ) + "-" + String(MAX_CPU_FREQ_MHZ) + " MHz");
+}
+
+PowerInfo getPowerInfo()
+{
+    PowerInfo info;
+    info.frequencyScaling = frequencyScaling;
+    info.minFreqMhz = frequencyScaling ? MIN_CPU_FREQ_MHZ : MAX_CPU_FREQ_MHZ;
+    info.maxFreqMhz = MAX_CPU_FREQ_MHZ;
+    info.cpuFreqMhz = getCpuFrequencyMhz();
+
+    // the loop task's split, the server task wakes every 10ms on top of this
+    JobSchedulerStats stats = getJobSchedulerStats();
+    float total = stats.asleepMs + stats.awakeMs;
+    float asleep = total > 0 ? stats.asleepMs / total : 0;
+    float waitingCurrent = frequencyScaling ? IDLE_SCALED_CURRENT_MA : IDLE_CURRENT_MA;
+    info.estimatedCurrentMa = (1 - asleep) * ACTIVE_CURRENT_MA + asleep * waitingCurrent;
+    return info;
+}
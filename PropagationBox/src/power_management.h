@@ -0,0 +1,26 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Lets the cpu clock down while every task is waiting. Light sleep stays off here, it would
+ * stop the LED's PWM and the web server has to be polled.
+ */
+void powerManagementSetup();
+
+struct PowerInfo
+{
+    /**
+     * Whether esp_pm_configure accepted frequency scaling
+     */
+    bool frequencyScaling;
+    uint32_t minFreqMhz;
+    uint32_t maxFreqMhz;
+    uint32_t cpuFreqMhz;
+    /**
+     * Average draw of the chip without the radio, from the scheduler's asleep/awake split
+     * and datasheet figures, in mA
+     */
+    float estimatedCurrentMa;
+};
+
+PowerInfo getPowerInfo();
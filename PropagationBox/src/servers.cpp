@@ -8,6 +8,10 @@
 #include "preferences_helpers.h"
 #include "time_helpers.h"
 #include "json.h"
+#include "job_scheduler.h"
+#include "power_management.h"
+#include "aht20.h"
+#include "ds18b20.h"
 #include "../preact/build/static_files.h"
 
 WebServer server(80);
@@ -37,6 +41,44 @@ void getSensorInfo()
     );
 }
 
+/**
+ * Read counts, failures and latencies of each sensor driver
+ */
+void getSensorStats()
+{
+    Aht20Stats aht20 = getAht20Stats();
+    Ds18b20Stats ds18b20 = getDs18b20Stats();
+    std::map<String, String> sensors;
+    // clang-format off
+    sensors["aht20"] = buildJson({
+        {"Reads", String(aht20.reads)},
+        {"Failures", String(aht20.failures)},
+        {"ConsecutiveFailures", String(aht20.consecutiveFailures)},
+        {"Resets", String(aht20.resets)},
+        {"LastLatencyUs", String(aht20.lastLatencyUs)},
+        {"MaxLatencyUs", String(aht20.maxLatencyUs)},
+        {"MaxBusUs", String(aht20.maxBusUs)}
+    });
+    sensors["ds18b20"] = buildJson({
+        {"Probes", String(ds18b20.probes)},
+        {"Conversions", String(ds18b20.conversions)},
+        {"Discoveries", String(ds18b20.discoveries)},
+        {"LastLatencyUs", String(ds18b20.lastLatencyUs)},
+        {"MaxLatencyUs", String(ds18b20.maxLatencyUs)},
+        {"MaxBusUs", String(ds18b20.maxBusUs)}
+    });
+    for (uint32_t i = 0; i < ds18b20.probes; i++)
+    {
+        sensors["ds18b20_" + String(i)] = buildJson({
+            {"Reads", String(ds18b20.probe[i].reads)},
+            {"Failures", String(ds18b20.probe[i].failures)},
+            {"ConsecutiveFailures", String(ds18b20.probe[i].consecutiveFailures)}
+        });
+    }
+    // clang-format on
+    server.send(200, "application/json", buildJsonOfJson(sensors));
+}
+
 void getPeripherals()
 {
     server.send(
@@ -224,6 +266,55 @@ void getGlobalInfo()
     );
 }
 
+/**
+ * Run counts, lateness and run time of every scheduled job, to see which one is late and why
+ */
+void getJobs()
+{
+    std::map<String, String> jobs;
+    for (int i = 0; i < getJobCount(); i++)
+    {
+        JobStats stats = getJobStats(i);
+        // clang-format off
+        jobs[getJobName(i)] = buildJson({
+            {"IntervalMs", String(getJobInterval(i))},
+            {"Runs", String(stats.runs)},
+            {"Overruns", String(stats.overruns)},
+            {"LastLateMs", String(stats.lastLateMs)},
+            {"MaxLateMs", String(stats.maxLateMs)},
+            {"AvgLateMs", String(stats.runs > 0 ? (float)stats.totalLateMs / stats.runs : 0, 2)},
+            {"LastRunUs", String(stats.lastRunUs)},
+            {"MaxRunUs", String(stats.maxRunUs)}
+        });
+        // clang-format on
+    }
+    server.send(200, "application/json", buildJsonOfJson(jobs));
+}
+
+/**
+ * Clock settings and how much of the time the loop spends waiting for its next job
+ */
+void getPower()
+{
+    PowerInfo power = getPowerInfo();
+    JobSchedulerStats stats = getJobSchedulerStats();
+    uint32_t totalMs = stats.asleepMs + stats.awakeMs;
+    // clang-format off
+    server.send(200, "application/json", buildJson({
+        {"FrequencyScaling", String(power.frequencyScaling)},
+        {"MinFreqMhz", String(power.minFreqMhz)},
+        {"MaxFreqMhz", String(power.maxFreqMhz)},
+        {"CpuFreqMhz", String(power.cpuFreqMhz)},
+        {"Sleeps", String(stats.sleeps)},
+        {"EventWakes", String(stats.eventWakes)},
+        {"AsleepMs", String(stats.asleepMs)},
+        {"AwakeMs", String(stats.awakeMs)},
+        {"AsleepPercent", String(totalMs > 0 ? 100.0f * stats.asleepMs / totalMs : 0, 2)},
+        {"EstimatedCurrentMa", String(power.estimatedCurrentMa, 2)}
+    }));
+    // clang-format on
+}
+
 void onReset()
 {
     // hardware reset
@@ -242,10 +333,13 @@ void serverSetup()
     server.on("/global-info", HTTP_GET, getGlobalInfo);
     server.on("/wifi-settings", HTTP_POST, handleWifiSettings);
     server.on("/sensor-info", HTTP_GET, getSensorInfo);
+    server.on("/sensor-stats", HTTP_GET, getSensorStats);
     server.on("/peripherals", HTTP_GET, getPeripherals);
     server.on("/environmental-controls", HTTP_GET, getEnvironmentalControlValues);
     server.on("/environmental-controls", HTTP_POST, setEnvironmentalControlValues);
     server.on("/reset", HTTP_POST, onReset);
+    server.on("/jobs", HTTP_GET, getJobs);
+    server.on("/power", HTTP_GET, getPower);
     server.onNotFound(handleNotFound);
     setupPreactPage();
     setupOTAUpdate();
@@ -1,4 +1,3 @@
 #pragma once
 
-void initializeSensor(void);
-void temperatureMoistureLoop(void);
\ No newline at end of file
+void temperatureMoistureSetup(void);
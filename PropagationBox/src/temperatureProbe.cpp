@@ -0,0 +1,31 @@
+#include <Arduino.h>
+#include "definitions.h"
+#include "ds18b20.h"
+#include "temperatureProbe.h"
+
+constexpr unsigned long DS18B20_INTERVAL_MS = 30000;
+
+static_assert(DS18B20_MAX_PROBES == MAX_PROBES, "every probe the driver reads needs somewhere to go");
+
+static void onDs18b20Reading(int probe, bool ok, float temperature)
+{
+    if (ok)
+    {
+        Serial.println("Probe " + String(probe) + " temperature: " + String(temperature, 2) + "C");
+    }
+    else
+    {
+        Serial.println("Could not read temperature probe " + String(probe) + "! Check wiring.");
+        temperature = -1;
+    }
+    PROBE_TEMPERATURES[probe] = temperature;
+    if (probe == 0)
+    {
+        CURRENT_PROBE_TEMPERATURE = temperature;
+    }
+}
+
+void temperatureProbeSetup()
+{
+    ds18b20Setup(DS18B20_PIN, DS18B20_INTERVAL_MS, onDs18b20Reading);
+}
@@ -2,12 +2,13 @@
 #include <WiFi.h>
 #include "time.h"
 #include "definitions.h"
-#include "interval_timer.h"
+#include "job_scheduler.h"
+#include "time_helpers.h"
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
 
 static String WORLDTIME_API = "http://worldtimeapi.org/api/ip";
-static Timer timer(5 * 60 * 1000);
+constexpr unsigned long TIME_UPDATE_INTERVAL_MS = 5 * 60 * 1000;
 constexpr int MINUTES_IN_DAY = 24 * 60;
 
 /**
@@ -76,16 +77,16 @@ int normalizeTimeToStartTime(int minuteOfDay, int startTime)
     return mod(minuteOfDay - startTime, MINUTES_IN_DAY);
 }
 
+void timeSetup()
+{
+    addPeriodicJob("time", TIME_UPDATE_INTERVAL_MS, updateTimeLoop);
+}
+
 /**
  * Updates the time from the internet
  */
 void updateTimeLoop()
 {
-    if (!timer.isIntervalPassed())
-    {
-        return;
-    }
-
     if (WiFi.getMode() == WIFI_AP || WiFi.status() != WL_CONNECTED)
     {
         // If in AP mode or disconnected, we can't get time from the internet
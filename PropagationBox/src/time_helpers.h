@@ -2,6 +2,7 @@
 
 #pragma once
 
+void timeSetup();
 void updateTimeLoop();
 int normalizeTimeToStartTime(int minuteOfDay, int startTime);
 String getLocalTimeString();
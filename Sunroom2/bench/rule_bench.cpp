@@ -0,0 +1,283 @@
+/**
+ * Rule engine micro-benchmark, built by the bench environment:
+ * pio run -e bench && .pio/build/bench/program
+ *
+ * Every rule in the corpus is evaluated three ways:
+ * json - deserializeJson + processRelayRule, what every tick used to cost
+ * tree - processRelayRule on an already parsed document
+ * vm   - runRuleProgram on the compiled (unoptimized) program, what the loop runs now
+ *
+ * nodes_per_eval is RULE_NODE_VISITS per evaluation: json nodes for json and tree, which
+ * evaluate every AND/OR operand, and instructions for vm, which stops at the operand that
+ * decides the result. The tree walker only knows binary AND/OR, so on the and_or_wide rules
+ * it reads the first two operands and its numbers aren't comparable.
+ *
+ * Prints one json object per line so runs can be diffed across commits.
+ * SUNROOM_BENCH_ITERATIONS overrides the number of evaluations per case.
+ */
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <native_hal.h>
+#include <chrono>
+#include <malloc.h>
+#include <vector>
+#include "../src/definitions.h"
+#include "../src/rule_helpers.h"
+#include "../src/rule_compiler.h"
+#include "../src/symbol_registry.h"
+#include "../src/time_helpers.h"
+
+// Same limit RuleParser.ts puts on a rule
+constexpr size_t MAX_RULE_SIZE = 256;
+constexpr long DEFAULT_ITERATIONS = 20000;
+
+/**
+ * Every heap allocation goes through malloc, including operator new and
+ * ArduinoJson's allocator, so counting here catches all of them (glibc only)
+ */
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static bool counting = false;
+static long allocations = 0;
+static long liveBytes = 0;
+static long peakBytes = 0;
+
+static void countAllocation(void *ptr)
+{
+    if (ptr == nullptr || !counting)
+    {
+        return;
+    }
+    allocations++;
+    liveBytes += malloc_usable_size(ptr);
+    peakBytes = std::max(peakBytes, liveBytes);
+}
+
+static void countFree(void *ptr)
+{
+    if (ptr != nullptr && counting)
+    {
+        liveBytes -= malloc_usable_size(ptr);
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    countAllocation(ptr);
+    return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    countAllocation(ptr);
+    return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    countFree(ptr);
+    void *out = __libc_realloc(ptr, size);
+    countAllocation(out);
+    return out;
+}
+
+extern "C" void free(void *ptr)
+{
+    countFree(ptr);
+    __libc_free(ptr);
+}
+
+struct BenchRule
+{
+    String name;
+    String rule;
+};
+
+/**
+ * ["IF", condition, ["SET", "relay_0", 1], ["SET", "relay_0", 0]]
+ */
+static String ifRule(const String &condition)
+{
+    return "[\"IF\"," + condition + ",[\"SET\",\"relay_0\",1],[\"SET\",\"relay_0\",0]]";
+}
+
+static const char *COMPARISON_OPERANDS[] = {
+    "[\"GT\",\"temperature\",25]",
+    "[\"LT\",\"humidity\",60]",
+    "[\"GT\",\"photoSensor\",1000]",
+    "[\"EQ\",\"lightSwitch\",1]",
+    "[\"GTE\",\"currentTime\",\"@06:30\"]",
+    "[\"LT\",\"currentTime\",\"@20:00\"]",
+};
+constexpr int COMPARISON_OPERAND_COUNT = sizeof(COMPARISON_OPERANDS) / sizeof(COMPARISON_OPERANDS[0]);
+
+/**
+ * Wrap comparisons in alternating AND/OR until the next one would go over the size limit.
+ * Deep nests every operator inside the last, otherwise operands are added to a flat
+ * operator which is nested when it gets to four operands.
+ */
+static std::vector<BenchRule> andOrRules(bool deep)
+{
+    std::vector<BenchRule> rules;
+    String condition = COMPARISON_OPERANDS[0];
+    for (int i = 1;; i++)
+    {
+        String op = i % 2 ? "AND" : "OR";
+        String operand = COMPARISON_OPERANDS[i % COMPARISON_OPERAND_COUNT];
+        String next;
+        if (deep || i % 4 == 1)
+        {
+            next = "[\"" + op + "\"," + operand + "," + condition + "]";
+        }
+        else
+        {
+            // add another operand to the outermost operator
+            next = condition.substring(0, condition.length() - 1) + "," + operand + "]";
+        }
+        if (ifRule(next).length() > MAX_RULE_SIZE)
+        {
+            break;
+        }
+        condition = next;
+        String rule = ifRule(condition);
+        rules.push_back({String(deep ? "and_or_deep_" : "and_or_wide_") + String(rule.length()), rule});
+    }
+    return rules;
+}
+
+/**
+ * Rules a greenhouse actually runs, written with binary AND/OR so the tree walker takes them
+ * too. With the fixed readings in main some conditions are settled by their first operand.
+ */
+static const BenchRule GREENHOUSE_RULES[] = {
+    {"vent_hot_or_humid", ifRule("[\"OR\",[\"GT\",\"temperature\",28],[\"GT\",\"humidity\",80]]")},
+    {"heater_cold_and_switch_off", ifRule("[\"AND\",[\"LT\",\"temperature\",15],[\"NOT\",[\"EQ\",\"lightSwitch\",1]]]")},
+    {"grow_lights_daytime_and_dark", ifRule("[\"AND\",[\"GT\",\"photoSensor\",800],[\"AND\",[\"GTE\",\"currentTime\",\"@06:00\"],[\"LT\",\"currentTime\",\"@20:00\"]]]")},
+    {"mist_warm_dry_daytime", ifRule("[\"AND\",[\"AND\",[\"GT\",\"temperature\",24],[\"LT\",\"humidity\",50]],[\"AND\",[\"GTE\",\"currentTime\",\"@08:00\"],[\"LT\",\"currentTime\",\"@18:00\"]]]")},
+    {"fan_switch_or_hot_or_humid", ifRule("[\"OR\",[\"EQ\",\"lightSwitch\",1],[\"OR\",[\"GT\",\"temperature\",30],[\"GT\",\"humidity\",85]]]")},
+    {"nested_if_hot_else_dry", "[\"IF\",[\"GT\",\"temperature\",30],[\"SET\",\"relay_1\",1],[\"IF\",[\"AND\",[\"LT\",\"humidity\",40],[\"GT\",\"temperature\",20]],[\"SET\",\"relay_1\",1],[\"SET\",\"relay_1\",0]]]"},
+};
+
+/**
+ * The shapes documented at the top of rule_helpers.cpp, the greenhouse rules, plus AND/OR
+ * trees up to the size limit
+ */
+static std::vector<BenchRule> ruleCorpus()
+{
+    std::vector<BenchRule> rules = {
+        {"nop", "[\"NOP\"]"},
+        {"temperature_eq", ifRule("[\"EQ\",\"temperature\",25]")},
+        {"temperature_gt", ifRule("[\"GT\",\"temperature\",25]")},
+        {"temperature_range", ifRule("[\"AND\",[\"GT\",\"temperature\",25],[\"LT\",\"temperature\",30]]")},
+        {"time_gt", ifRule("[\"GT\",\"currentTime\",\"@12:00\"]")},
+        {"time_eq", ifRule("[\"EQ\",\"currentTime\",\"@12:00\"]")},
+        {"light_gt", ifRule("[\"GT\",\"photoSensor\",1000]")},
+        {"switch_eq", ifRule("[\"EQ\",\"lightSwitch\",1]")},
+    };
+    for (const BenchRule &rule : GREENHOUSE_RULES)
+    {
+        rules.push_back(rule);
+    }
+    for (const BenchRule &rule : andOrRules(true))
+    {
+        rules.push_back(rule);
+    }
+    for (const BenchRule &rule : andOrRules(false))
+    {
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+struct BenchResult
+{
+    double nsPerEval;
+    double nodesPerEval;
+    double allocsPerEval;
+    long peakHeapBytes;
+};
+
+template <typename Evaluate>
+static BenchResult measure(long iterations, Evaluate evaluate)
+{
+    // warm up caches and any lazily allocated state
+    for (long i = 0; i < iterations / 10 + 1; i++)
+    {
+        evaluate();
+    }
+
+    allocations = 0;
+    liveBytes = 0;
+    peakBytes = 0;
+    uint32_t nodes = RULE_NODE_VISITS;
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++)
+    {
+        evaluate();
+    }
+    auto end = std::chrono::steady_clock::now();
+    counting = false;
+    nodes = RULE_NODE_VISITS - nodes;
+
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return {ns / iterations, static_cast<double>(nodes) / iterations, static_cast<double>(allocations) / iterations, peakBytes};
+}
+
+static void printResult(const BenchRule &rule, const char *engine, long iterations, const BenchResult &result)
+{
+    printf("{\"rule\":\"%s\",\"engine\":\"%s\",\"bytes\":%u,\"iterations\":%ld,"
+           "\"ns_per_eval\":%.1f,\"nodes_per_eval\":%.1f,\"allocs_per_eval\":%.2f,\"peak_heap_bytes\":%ld}\n",
+           rule.name.c_str(), engine, rule.rule.length(), iterations,
+           result.nsPerEval, result.nodesPerEval, result.allocsPerEval, result.peakHeapBytes);
+}
+
+int main()
+{
+    simSetSerialEnabled(false);
+
+    const char *iterationsEnv = getenv("SUNROOM_BENCH_ITERATIONS");
+    long iterations = iterationsEnv != nullptr ? atol(iterationsEnv) : DEFAULT_ITERATIONS;
+
+    // fixed sensor readings so every run takes the same branches
+    CURRENT_TEMPERATURE = 27;
+    CURRENT_HUMIDITY = 55;
+    LIGHT_LEVEL = 1500;
+    IS_SWITCH_ON = 1;
+    refreshSensorValues();
+    updateSensorValue(SENSOR_CURRENT_TIME, getCurrentMinutes());
+
+    for (const BenchRule &rule : ruleCorpus())
+    {
+        BenchResult json = measure(iterations, [&]()
+                                   {
+            DynamicJsonDocument doc(1024);
+            deserializeJson(doc, rule.rule);
+            processRelayRule(doc.as<JsonVariantConst>()); });
+        printResult(rule, "json", iterations, json);
+
+        DynamicJsonDocument doc(1024);
+        deserializeJson(doc, rule.rule);
+        JsonVariantConst parsed = doc.as<JsonVariantConst>();
+        BenchResult tree = measure(iterations, [&]()
+                                   { processRelayRule(parsed); });
+        printResult(rule, "tree", iterations, tree);
+
+        RuleProgram program;
+        if (compileRule(rule.rule, program) != NO_ERROR)
+        {
+            fprintf(stderr, "%s failed to compile\n", rule.name.c_str());
+            continue;
+        }
+        RuleValue result;
+        BenchResult vm = measure(iterations, [&]()
+                                 { runRuleProgram(program, result); });
+        printResult(rule, "vm", iterations, vm);
+    }
+    return 0;
+}
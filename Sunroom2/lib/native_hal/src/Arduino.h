@@ -0,0 +1,144 @@
+#pragma once
+/**
+ * Host stand-in for the ESP32 Arduino core. Pins, the ADC and the clock are
+ * simulated in native_hal.cpp, see native_hal.h for the simulation hooks.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include "WString.h"
+#include "freertos/FreeRTOS.h"
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define INPUT_PULLDOWN 0x09
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define ONLOW 0x04
+#define ONHIGH 0x05
+// level triggered and able to wake the chip from light sleep
+#define ONLOW_WE 0x0C
+#define ONHIGH_WE 0x0D
+
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+
+#define PROGMEM
+#define IRAM_ATTR
+#define F(string) (string)
+
+using std::abs;
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+bool adcAttachPin(uint8_t pin);
+/**
+ * ADC1 channel of an ESP32 pin, -1 for a pin that isn't on ADC1
+ */
+int8_t digitalPinToAnalogChannel(uint8_t pin);
+void dacWrite(uint8_t pin, uint8_t value);
+
+/**
+ * Internal chip temperature in celsius
+ */
+float temperatureRead();
+
+/**
+ * Interrupts run on the thread that changes the pin (simSetDigitalInput).
+ * Level interrupts fire while the pin is at the level and the interrupt is enabled.
+ */
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr);
+void configTzTime(const char *tz, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr);
+
+class Print
+{
+public:
+    virtual ~Print() = default;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+
+    size_t print(const String &str);
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(int number, int base = DEC);
+    size_t print(unsigned int number, int base = DEC);
+    size_t print(long number, int base = DEC);
+    size_t print(unsigned long number, int base = DEC);
+    size_t print(double number, int decimals = 2);
+
+    size_t println();
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(const T &value, int format)
+    {
+        size_t n = print(value, format);
+        return n + println();
+    }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+typedef Print Stream;
+
+/**
+ * Serial writes to stdout
+ */
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long baud) {}
+    void setDebugOutput(bool enable) {}
+    size_t write(const uint8_t *buffer, size_t size) override;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint64_t getEfuseMac();
+    /**
+     * There is nothing to reboot into on the host, the process exits
+     */
+    void restart();
+};
+
+extern EspClass ESP;
+
+void setup();
+void loop();
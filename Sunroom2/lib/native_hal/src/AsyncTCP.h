@@ -0,0 +1,2 @@
+#pragma once
+// Nothing to do on the host, requests are dispatched by simRequest()
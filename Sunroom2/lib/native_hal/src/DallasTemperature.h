@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include "OneWire.h"
+
+typedef uint8_t DeviceAddress[8];
+
+#define DEVICE_DISCONNECTED_C -127
+
+/**
+ * Simulated probes that report what simSetProbeTemperature() was last given. A reading is what
+ * the probe had when the last conversion started, once 750ms have passed, like on the real bus.
+ */
+class DallasTemperature
+{
+public:
+    DallasTemperature(OneWire *oneWire) {}
+    void begin();
+    uint8_t getDeviceCount();
+    bool getAddress(uint8_t *address, uint8_t index);
+    void setWaitForConversion(bool wait);
+    void requestTemperatures();
+    int16_t millisToWaitForConversion();
+    float getTempC(const uint8_t *address);
+    float getTempCByIndex(uint8_t index);
+
+private:
+    bool waitForConversion = true;
+};
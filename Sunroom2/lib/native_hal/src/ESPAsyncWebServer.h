@@ -0,0 +1,123 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <vector>
+
+typedef enum
+{
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+class AsyncWebServerRequest;
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+
+class AsyncWebParameter
+{
+public:
+    AsyncWebParameter(const String &name, const String &value, bool isPost) : _name(name), _value(value), _isPost(isPost) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+    bool isPost() const { return _isPost; }
+
+private:
+    String _name;
+    String _value;
+    bool _isPost;
+};
+
+class AsyncWebServerResponse
+{
+public:
+    virtual ~AsyncWebServerResponse() = default;
+    AsyncWebServerResponse(int code, const String &contentType, const String &content) : code(code), contentType(contentType), content(content) {}
+    void addHeader(const String &name, const String &value) { headers[name] = value; }
+
+    int code;
+    String contentType;
+    String content;
+    std::map<String, String> headers;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print
+{
+public:
+    AsyncResponseStream(const String &contentType) : AsyncWebServerResponse(200, contentType, String()) {}
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        content.concat(reinterpret_cast<const char *>(buffer), size);
+        return size;
+    }
+};
+
+/**
+ * A request handed to the handlers by simRequest()
+ */
+class AsyncWebServerRequest
+{
+public:
+    AsyncWebServerRequest(WebRequestMethod method, const String &url, const std::vector<AsyncWebParameter> &params) : _method(method), _url(url), _params(params) {}
+    ~AsyncWebServerRequest() { delete _response; }
+
+    WebRequestMethod method() const { return _method; }
+    const String &url() const { return _url; }
+
+    bool hasParam(const String &name, bool post = false) const { return getParam(name, post) != nullptr; }
+    const AsyncWebParameter *getParam(const String &name, bool post = false) const;
+    size_t args() const { return _params.size(); }
+    const String &argName(size_t i) const { return _params[i].name(); }
+    const String &arg(size_t i) const { return _params[i].value(); }
+
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType, const String &content = String());
+    AsyncResponseStream *beginResponseStream(const String &contentType) { return new AsyncResponseStream(contentType); }
+    AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len);
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &contentType = String(), const String &content = String());
+
+    /**
+     * What the handler sent, nullptr if it hasn't sent anything
+     */
+    const AsyncWebServerResponse *response() const { return _response; }
+
+private:
+    WebRequestMethod _method;
+    String _url;
+    std::vector<AsyncWebParameter> _params;
+    AsyncWebServerResponse *_response = nullptr;
+};
+
+class AsyncWebServer
+{
+public:
+    AsyncWebServer(uint16_t port) {}
+
+    void on(const char *uri, ArRequestHandlerFunction onRequest);
+    void on(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest);
+    void on(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload);
+    void onNotFound(ArRequestHandlerFunction onRequest);
+    void begin();
+
+    /**
+     * Run the handler registered for the request's url and method
+     */
+    void handle(AsyncWebServerRequest *request);
+
+private:
+    struct Route
+    {
+        String uri;
+        WebRequestMethod method;
+        ArRequestHandlerFunction onRequest;
+    };
+    std::vector<Route> routes;
+    ArRequestHandlerFunction notFound;
+};
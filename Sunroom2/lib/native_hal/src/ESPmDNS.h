@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+
+class MDNSResponder
+{
+public:
+    bool begin(const char *hostName) { return true; }
+};
+
+extern MDNSResponder MDNS;
@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Answered by simHttpGet, see simSetHttpResponse
+ */
+int simHttpGet(const String &url, String &body);
+
+/**
+ * Outgoing http is simulated, GET answers whatever simSetHttpResponse set for the url
+ * and every other request fails like a dropped connection
+ */
+class HTTPClient
+{
+public:
+    bool begin(const String &url)
+    {
+        this->url = url;
+        return true;
+    }
+    void setTimeout(uint16_t timeout) {}
+    void setConnectTimeout(int32_t timeout) {}
+    int GET() { return simHttpGet(url, body); }
+    String getString() { return body; }
+    void end() {}
+
+private:
+    String url;
+    String body;
+};
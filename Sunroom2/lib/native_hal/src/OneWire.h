@@ -0,0 +1,8 @@
+#pragma once
+#include <Arduino.h>
+
+class OneWire
+{
+public:
+    OneWire(uint8_t pin) {}
+};
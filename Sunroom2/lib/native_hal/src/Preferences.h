@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * NVS stand-in, keys live in memory for the life of the process
+ */
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end();
+
+    bool isKey(const char *key);
+    bool remove(const char *key);
+    bool clear();
+
+    size_t putString(const char *key, const char *value);
+    size_t putString(const char *key, const String &value);
+    String getString(const char *key, const String &defaultValue = String());
+
+    size_t putBytes(const char *key, const void *value, size_t length);
+    size_t getBytesLength(const char *key);
+    size_t getBytes(const char *key, void *buffer, size_t maxLength);
+
+private:
+    String ns;
+    bool started = false;
+};
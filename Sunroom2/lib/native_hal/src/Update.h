@@ -0,0 +1,19 @@
+#pragma once
+#include <Arduino.h>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+/**
+ * OTA updates are accepted and thrown away
+ */
+class UpdateClass
+{
+public:
+    bool begin(size_t size) { return true; }
+    size_t write(uint8_t *data, size_t len) { return len; }
+    bool end(bool evenIfRemaining = false) { return true; }
+    bool hasError() { return false; }
+    void printError(Print &out) { out.println("Update not supported in the native build"); }
+};
+
+extern UpdateClass Update;
@@ -0,0 +1,213 @@
+#include "WString.h"
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static std::string formatUnsigned(unsigned long long number, unsigned char base)
+{
+    if (number == 0)
+    {
+        return "0";
+    }
+    std::string out;
+    while (number > 0)
+    {
+        int digit = number % base;
+        out.push_back(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        number /= base;
+    }
+    std::reverse(out.begin(), out.end());
+    return out;
+}
+
+static std::string formatSigned(long long number, unsigned char base)
+{
+    if (number < 0 && base == DEC)
+    {
+        return "-" + formatUnsigned(-static_cast<unsigned long long>(number), base);
+    }
+    return formatUnsigned(static_cast<unsigned long long>(number), base);
+}
+
+String::String(int number, unsigned char base) : value(formatSigned(number, base)) {}
+String::String(unsigned int number, unsigned char base) : value(formatUnsigned(number, base)) {}
+String::String(long number, unsigned char base) : value(formatSigned(number, base)) {}
+String::String(unsigned long number, unsigned char base) : value(formatUnsigned(number, base)) {}
+String::String(long long number, unsigned char base) : value(formatSigned(number, base)) {}
+String::String(unsigned long long number, unsigned char base) : value(formatUnsigned(number, base)) {}
+String::String(float number, unsigned int decimals) : String(static_cast<double>(number), decimals) {}
+
+String::String(double number, unsigned int decimals)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+    value = buffer;
+}
+
+bool String::concat(const String &str)
+{
+    value += str.value;
+    return true;
+}
+
+bool String::concat(const char *str)
+{
+    if (str == nullptr)
+    {
+        return false;
+    }
+    value += str;
+    return true;
+}
+
+bool String::concat(const char *str, unsigned int length)
+{
+    if (str == nullptr)
+    {
+        return false;
+    }
+    value.append(str, length);
+    return true;
+}
+
+bool String::concat(char c)
+{
+    value.push_back(c);
+    return true;
+}
+
+String &String::operator+=(const String &str)
+{
+    concat(str);
+    return *this;
+}
+
+String &String::operator+=(const char *str)
+{
+    concat(str);
+    return *this;
+}
+
+String &String::operator+=(char c)
+{
+    concat(c);
+    return *this;
+}
+
+String &String::operator+=(int number) { return *this += String(number); }
+String &String::operator+=(unsigned int number) { return *this += String(number); }
+String &String::operator+=(long number) { return *this += String(number); }
+String &String::operator+=(unsigned long number) { return *this += String(number); }
+String &String::operator+=(float number) { return *this += String(number); }
+
+bool String::startsWith(const String &prefix) const
+{
+    return value.compare(0, prefix.value.size(), prefix.value) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    return value.size() >= suffix.value.size() &&
+           value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    size_t pos = value.find(c, from);
+    return pos == std::string::npos ? -1 : pos;
+}
+
+int String::indexOf(const String &str, unsigned int from) const
+{
+    size_t pos = value.find(str.value, from);
+    return pos == std::string::npos ? -1 : pos;
+}
+
+String String::substring(unsigned int from) const
+{
+    return substring(from, value.size());
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (from > to)
+    {
+        std::swap(from, to);
+    }
+    if (from >= value.size())
+    {
+        return String();
+    }
+    to = std::min<unsigned int>(to, value.size());
+    return String(value.data() + from, to - from);
+}
+
+void String::remove(unsigned int index)
+{
+    remove(index, value.size());
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index < value.size())
+    {
+        value.erase(index, count);
+    }
+}
+
+void String::trim()
+{
+    size_t start = value.find_first_not_of(" \t\r\n");
+    size_t end = value.find_last_not_of(" \t\r\n");
+    value = start == std::string::npos ? "" : value.substr(start, end - start + 1);
+}
+
+void String::toLowerCase()
+{
+    for (char &c : value)
+    {
+        c = tolower(c);
+    }
+}
+
+void String::toUpperCase()
+{
+    for (char &c : value)
+    {
+        c = toupper(c);
+    }
+}
+
+bool String::reserve(unsigned int size)
+{
+    value.reserve(size);
+    return true;
+}
+
+long String::toInt() const
+{
+    return atol(value.c_str());
+}
+
+float String::toFloat() const
+{
+    return atof(value.c_str());
+}
+
+static StringSumHelper append(const StringSumHelper &lhs, const String &rhs)
+{
+    StringSumHelper out(lhs);
+    out += rhs;
+    return out;
+}
+
+StringSumHelper operator+(const StringSumHelper &lhs, const String &rhs) { return append(lhs, rhs); }
+StringSumHelper operator+(const StringSumHelper &lhs, const char *rhs) { return append(lhs, String(rhs)); }
+StringSumHelper operator+(const StringSumHelper &lhs, char rhs) { return append(lhs, String(rhs)); }
+StringSumHelper operator+(const StringSumHelper &lhs, int rhs) { return append(lhs, String(rhs)); }
+StringSumHelper operator+(const StringSumHelper &lhs, unsigned int rhs) { return append(lhs, String(rhs)); }
+StringSumHelper operator+(const StringSumHelper &lhs, long rhs) { return append(lhs, String(rhs)); }
+StringSumHelper operator+(const StringSumHelper &lhs, unsigned long rhs) { return append(lhs, String(rhs)); }
+StringSumHelper operator+(const StringSumHelper &lhs, float rhs) { return append(lhs, String(rhs)); }
+StringSumHelper operator+(const char *lhs, const String &rhs) { return append(StringSumHelper(lhs), rhs); }
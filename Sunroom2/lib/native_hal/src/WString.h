@@ -0,0 +1,95 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+
+class StringSumHelper;
+
+/**
+ * Arduino String on top of std::string, only what the firmware uses
+ */
+class String
+{
+public:
+    String() = default;
+    String(const char *str) : value(str == nullptr ? "" : str) {}
+    String(const char *str, unsigned int length) : value(str == nullptr ? "" : std::string(str, length)) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(int number, unsigned char base = DEC);
+    explicit String(unsigned int number, unsigned char base = DEC);
+    explicit String(long number, unsigned char base = DEC);
+    explicit String(unsigned long number, unsigned char base = DEC);
+    explicit String(long long number, unsigned char base = DEC);
+    explicit String(unsigned long long number, unsigned char base = DEC);
+    explicit String(float number, unsigned int decimals = 2);
+    explicit String(double number, unsigned int decimals = 2);
+
+    unsigned int length() const { return value.size(); }
+    bool isEmpty() const { return value.empty(); }
+    const char *c_str() const { return value.c_str(); }
+    const std::string &str() const { return value; }
+
+    char operator[](unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    char &operator[](unsigned int index) { return value[index]; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+    const char *begin() const { return value.data(); }
+    const char *end() const { return value.data() + value.size(); }
+
+    bool concat(const String &str);
+    bool concat(const char *str);
+    bool concat(const char *str, unsigned int length);
+    bool concat(char c);
+    String &operator+=(const String &str);
+    String &operator+=(const char *str);
+    String &operator+=(char c);
+    String &operator+=(int number);
+    String &operator+=(unsigned int number);
+    String &operator+=(long number);
+    String &operator+=(unsigned long number);
+    String &operator+=(float number);
+
+    bool equals(const String &str) const { return value == str.value; }
+    bool operator==(const String &str) const { return value == str.value; }
+    bool operator==(const char *str) const { return value == (str == nullptr ? "" : str); }
+    bool operator!=(const String &str) const { return !(*this == str); }
+    bool operator!=(const char *str) const { return !(*this == str); }
+    bool operator<(const String &str) const { return value < str.value; }
+
+    bool startsWith(const String &prefix) const;
+    bool endsWith(const String &suffix) const;
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String &str, unsigned int from = 0) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    void remove(unsigned int index);
+    void remove(unsigned int index, unsigned int count);
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+    bool reserve(unsigned int size);
+
+    long toInt() const;
+    float toFloat() const;
+
+protected:
+    std::string value;
+};
+
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &str) : String(str) {}
+    StringSumHelper(const char *str) : String(str) {}
+};
+
+StringSumHelper operator+(const StringSumHelper &lhs, const String &rhs);
+StringSumHelper operator+(const StringSumHelper &lhs, const char *rhs);
+StringSumHelper operator+(const StringSumHelper &lhs, char rhs);
+StringSumHelper operator+(const StringSumHelper &lhs, int rhs);
+StringSumHelper operator+(const StringSumHelper &lhs, unsigned int rhs);
+StringSumHelper operator+(const StringSumHelper &lhs, long rhs);
+StringSumHelper operator+(const StringSumHelper &lhs, unsigned long rhs);
+StringSumHelper operator+(const StringSumHelper &lhs, float rhs);
+StringSumHelper operator+(const char *lhs, const String &rhs);
@@ -0,0 +1,2 @@
+#pragma once
+// The firmware only uses the async server, see ESPAsyncWebServer.h
@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3,
+} wifi_mode_t;
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+/**
+ * The host is always on the network, begin() connects straight away
+ */
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t mode);
+    wifi_mode_t getMode();
+    bool softAP(const String &ssid, const String &password);
+    wl_status_t begin(const char *ssid, const char *password);
+    wl_status_t status();
+
+private:
+    wifi_mode_t currentMode = WIFI_OFF;
+    wl_status_t currentStatus = WL_DISCONNECTED;
+};
+
+extern WiFiClass WiFi;
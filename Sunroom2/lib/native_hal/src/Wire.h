@@ -0,0 +1,34 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+/**
+ * I2C bus with a simulated AHT20 at 0x38 that reports what simSetAht20() was last given.
+ * A conversion takes 80ms like on the real sensor.
+ */
+class TwoWire
+{
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    bool setClock(uint32_t frequency);
+
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t length);
+    /**
+     * 0 on success, 2 if nothing acknowledged the address
+     */
+    uint8_t endTransmission(bool sendStop = true);
+
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    int available();
+    int read();
+
+private:
+    uint8_t address = 0;
+    std::vector<uint8_t> transmitBuffer;
+    std::vector<uint8_t> receiveBuffer;
+    size_t receiveIndex = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,10 @@
+#pragma once
+#include "../esp_err.h"
+
+enum gpio_num_t : int
+{
+    GPIO_NUM_NC = -1,
+};
+
+esp_err_t gpio_intr_enable(gpio_num_t pin);
+esp_err_t gpio_intr_disable(gpio_num_t pin);
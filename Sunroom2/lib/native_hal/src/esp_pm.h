@@ -0,0 +1,15 @@
+#pragma once
+#include "esp_err.h"
+
+/**
+ * The host has no clocks to scale, configuring always succeeds and the
+ * scheduler's own sleep accounting stands in for the real thing
+ */
+typedef struct
+{
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32_t;
+
+esp_err_t esp_pm_configure(const void *config);
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * CRC-32 (the zlib one), pass 0 to start and the previous result to continue
+ */
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buffer, uint32_t length);
@@ -0,0 +1,7 @@
+#pragma once
+#include "esp_err.h"
+
+inline esp_err_t esp_sleep_enable_gpio_wakeup()
+{
+    return ESP_OK;
+}
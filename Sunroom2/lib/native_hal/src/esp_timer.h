@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * One shot and periodic high resolution timers, the callbacks run on a timer thread like the
+ * esp_timer task. Starting a timer is safe from an interrupt handler, as on the device.
+ */
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum
+{
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+bool esp_timer_is_active(esp_timer_handle_t timer);
+
+/**
+ * Microseconds since boot
+ */
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,14 @@
+#pragma once
+#include "FreeRTOS.h"
+
+struct QueueDefinition;
+typedef QueueDefinition *QueueHandle_t;
+
+/**
+ * Thread safe fixed length queue of fixed size items, copied in and out like FreeRTOS does
+ */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
@@ -0,0 +1,67 @@
+#include "semphr.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Mutexes and binary semaphores are both a count of 0 or 1, a mutex starts at 1.
+ * Ownership isn't tracked.
+ */
+struct SemaphoreDefinition
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool available;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t semaphore = new SemaphoreDefinition();
+    semaphore->available = true;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    SemaphoreHandle_t semaphore = new SemaphoreDefinition();
+    semaphore->available = false;
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    auto ready = [semaphore]
+    { return semaphore->available; };
+    if (ticksToWait == portMAX_DELAY)
+    {
+        semaphore->changed.wait(lock, ready);
+    }
+    else if (!semaphore->changed.wait_for(lock, std::chrono::milliseconds(ticksToWait), ready))
+    {
+        return pdFALSE;
+    }
+    semaphore->available = false;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->available)
+    {
+        return pdFALSE;
+    }
+    semaphore->available = true;
+    semaphore->changed.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken)
+{
+    if (higherPriorityTaskWoken != nullptr)
+    {
+        *higherPriorityTaskWoken = pdFALSE;
+    }
+    return xSemaphoreGive(semaphore);
+}
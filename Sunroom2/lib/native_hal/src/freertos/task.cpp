@@ -0,0 +1,27 @@
+#include "task.h"
+#include <chrono>
+#include <thread>
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask)
+{
+    std::thread(task, parameters).detach();
+    if (createdTask != nullptr)
+    {
+        *createdTask = nullptr;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t core)
+{
+    return xTaskCreate(task, name, stackDepth, parameters, priority, createdTask);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
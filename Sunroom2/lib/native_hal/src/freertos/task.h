@@ -0,0 +1,21 @@
+#pragma once
+#include "FreeRTOS.h"
+
+struct TaskDefinition;
+typedef TaskDefinition *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskIDLE_PRIORITY 0
+
+/**
+ * Tasks are detached std::threads, priority and core are ignored
+ */
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+
+/**
+ * Only deleting the calling task (nullptr) is supported, it returns and the task's function
+ * then returns, which ends the thread
+ */
+void vTaskDelete(TaskHandle_t task);
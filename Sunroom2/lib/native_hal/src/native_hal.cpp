@@ -0,0 +1,1215 @@
+#include "native_hal.h"
+#include <Preferences.h>
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <Update.h>
+#include <Wire.h>
+#include <DallasTemperature.h>
+#include <driver/gpio.h>
+#include <driver/adc.h>
+#include <esp_pm.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <soc/soc.h>
+#include <soc/gpio_reg.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+#include <stdarg.h>
+#include <thread>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+constexpr int PIN_COUNT = 64;
+
+static std::atomic<int> PIN_VALUES[PIN_COUNT];
+static std::atomic<uint16_t> ANALOG_VALUES[PIN_COUNT];
+static std::atomic<uint32_t> GPIO_WRITES{0};
+
+struct AnalogWaveform
+{
+    uint16_t amplitude;
+    unsigned long periodMs;
+    uint16_t noise;
+};
+
+static AnalogWaveform ANALOG_WAVEFORMS[PIN_COUNT];
+
+// ADC1 channel to ESP32 pin
+static const uint8_t ADC1_PINS[] = {36, 37, 38, 39, 32, 33, 34, 35};
+constexpr int ADC1_CHANNEL_COUNT = sizeof(ADC1_PINS);
+// ADC2 channel to ESP32 pin, the core numbers these after SOC_ADC_MAX_CHANNEL_NUM
+static const uint8_t ADC2_PINS[] = {4, 0, 2, 15, 13, 12, 14, 27, 25, 26};
+constexpr int ADC_MAX_VALUE = 4095;
+
+struct PinInterrupt
+{
+    void (*handler)(void *);
+    void *arg;
+    int mode;
+    bool enabled;
+};
+
+static PinInterrupt PIN_INTERRUPTS[PIN_COUNT];
+static std::recursive_mutex interruptMutex;
+static uint32_t cpuFrequencyMhz = 240;
+
+static std::mutex simMutex;
+static float ahtTemperature = 22;
+static float ahtHumidity = 50;
+static bool ahtConnected = true;
+constexpr int SIM_MAX_PROBES = 8;
+constexpr unsigned long PROBE_SIM_CONVERSION_MS = 750;
+// what a DS18B20 reads before its first conversion
+constexpr float PROBE_SIM_POWER_ON_TEMPERATURE = 85;
+
+static float PROBE_TEMPERATURES[SIM_MAX_PROBES] = {20, 20, 20, 20, 20, 20, 20, 20};
+// which probes are on the bus, a probe's address is its index so it keeps it across searches
+static bool PROBE_CONNECTED[SIM_MAX_PROBES] = {true};
+static float CONVERTING_TEMPERATURES[SIM_MAX_PROBES];
+static float CONVERTED_TEMPERATURES[SIM_MAX_PROBES];
+static unsigned long probeConversionMs = 0;
+static bool probeConverting = false;
+
+static const auto START = std::chrono::steady_clock::now();
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+MDNSResponder MDNS;
+UpdateClass Update;
+
+/**
+ * Time
+ */
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - START).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START).count();
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms)
+{
+    // the host clock is always set
+    time_t now = time(nullptr);
+    localtime_r(&now, info);
+    return info->tm_year > (2016 - 1900);
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2, const char *server3)
+{
+    // the host keeps its own time and timezone
+}
+
+void configTzTime(const char *tz, const char *server1, const char *server2, const char *server3)
+{
+    // the host keeps its own time, the timezone is set like on the device
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+struct SimHttpResponse
+{
+    int code;
+    String body;
+    unsigned long delayMs;
+};
+
+static std::map<String, SimHttpResponse> httpResponses;
+
+void simSetHttpResponse(const String &url, int code, const String &body, unsigned long delayMs)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    httpResponses[url] = {code, body, delayMs};
+}
+
+int simHttpGet(const String &url, String &body)
+{
+    SimHttpResponse response = {-1, String(), 0};
+    {
+        std::lock_guard<std::mutex> lock(simMutex);
+        auto found = httpResponses.find(url);
+        if (found != httpResponses.end())
+        {
+            response = found->second;
+        }
+    }
+    delay(response.delayMs);
+    body = response.body;
+    return response.code;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return 1;
+}
+
+/**
+ * GPIO and ADC
+ */
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    PIN_VALUES[pin % PIN_COUNT] = value ? HIGH : LOW;
+    GPIO_WRITES++;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return PIN_VALUES[pin % PIN_COUNT];
+}
+
+/**
+ * What the ADC converts on pin at us
+ */
+static uint16_t sampleAnalog(uint8_t pin, uint64_t us)
+{
+    const AnalogWaveform &waveform = ANALOG_WAVEFORMS[pin % PIN_COUNT];
+    float value = ANALOG_VALUES[pin % PIN_COUNT];
+    if (waveform.amplitude > 0 && waveform.periodMs > 0)
+    {
+        value += waveform.amplitude * sinf(2 * M_PI * (us % (waveform.periodMs * 1000)) / (waveform.periodMs * 1000.0f));
+    }
+    if (waveform.noise > 0)
+    {
+        value += rand() % (2 * waveform.noise + 1) - waveform.noise;
+    }
+    return constrain(static_cast<int>(value), 0, ADC_MAX_VALUE);
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+    return sampleAnalog(pin, micros());
+}
+
+bool adcAttachPin(uint8_t pin)
+{
+    return true;
+}
+
+int8_t digitalPinToAnalogChannel(uint8_t pin)
+{
+    for (int channel = 0; channel < ADC1_CHANNEL_COUNT; channel++)
+    {
+        if (ADC1_PINS[channel] == pin)
+        {
+            return channel;
+        }
+    }
+    for (int channel = 0; channel < static_cast<int>(sizeof(ADC2_PINS)); channel++)
+    {
+        if (ADC2_PINS[channel] == pin)
+        {
+            return SOC_ADC_MAX_CHANNEL_NUM + channel;
+        }
+    }
+    return -1;
+}
+
+void dacWrite(uint8_t pin, uint8_t value)
+{
+}
+
+float temperatureRead()
+{
+    return 45;
+}
+
+static void callInterruptHandler(void *arg)
+{
+    reinterpret_cast<void (*)()>(arg)();
+}
+
+/**
+ * Run the pin's handler if the change (or for level interrupts the current level) triggers it
+ */
+static void raiseInterrupt(uint8_t pin, int previous)
+{
+    std::lock_guard<std::recursive_mutex> lock(interruptMutex);
+    PinInterrupt &interrupt = PIN_INTERRUPTS[pin % PIN_COUNT];
+    if (interrupt.handler == nullptr || !interrupt.enabled)
+    {
+        return;
+    }
+    int value = PIN_VALUES[pin % PIN_COUNT];
+    bool fire = false;
+    switch (interrupt.mode)
+    {
+    case RISING:
+        fire = previous == LOW && value == HIGH;
+        break;
+    case FALLING:
+        fire = previous == HIGH && value == LOW;
+        break;
+    case CHANGE:
+        fire = previous != value;
+        break;
+    case ONLOW:
+    case ONLOW_WE:
+        fire = value == LOW;
+        break;
+    case ONHIGH:
+    case ONHIGH_WE:
+        fire = value == HIGH;
+        break;
+    }
+    if (fire)
+    {
+        interrupt.handler(interrupt.arg);
+    }
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(interruptMutex);
+        PIN_INTERRUPTS[pin % PIN_COUNT] = {handler, arg, mode, true};
+    }
+    raiseInterrupt(pin, PIN_VALUES[pin % PIN_COUNT]);
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode)
+{
+    attachInterruptArg(pin, callInterruptHandler, reinterpret_cast<void *>(handler), mode);
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    std::lock_guard<std::recursive_mutex> lock(interruptMutex);
+    PIN_INTERRUPTS[pin % PIN_COUNT] = {};
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t pin)
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(interruptMutex);
+        PIN_INTERRUPTS[pin % PIN_COUNT].enabled = true;
+    }
+    raiseInterrupt(pin, PIN_VALUES[pin % PIN_COUNT]);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t pin)
+{
+    std::lock_guard<std::recursive_mutex> lock(interruptMutex);
+    PIN_INTERRUPTS[pin % PIN_COUNT].enabled = false;
+    return ESP_OK;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz)
+{
+    cpuFrequencyMhz = mhz;
+    return true;
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+    return cpuFrequencyMhz;
+}
+
+esp_err_t esp_pm_configure(const void *config)
+{
+    return ESP_OK;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+void simSetDigitalInput(uint8_t pin, int value)
+{
+    int previous = PIN_VALUES[pin % PIN_COUNT].exchange(value ? HIGH : LOW);
+    raiseInterrupt(pin, previous);
+}
+
+void simSetAnalogInput(uint8_t pin, uint16_t value)
+{
+    ANALOG_VALUES[pin % PIN_COUNT] = value;
+}
+
+void simSetAnalogWaveform(uint8_t pin, uint16_t amplitude, unsigned long periodMs, uint16_t noise)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    ANALOG_WAVEFORMS[pin % PIN_COUNT] = {amplitude, periodMs, noise};
+}
+
+void simRegisterWrite(uint32_t reg, uint32_t value)
+{
+    if (reg != GPIO_OUT_W1TS_REG && reg != GPIO_OUT_W1TC_REG && reg != GPIO_OUT1_W1TS_REG && reg != GPIO_OUT1_W1TC_REG)
+    {
+        return;
+    }
+    int firstPin = reg == GPIO_OUT1_W1TS_REG || reg == GPIO_OUT1_W1TC_REG ? 32 : 0;
+    int level = reg == GPIO_OUT_W1TS_REG || reg == GPIO_OUT1_W1TS_REG ? HIGH : LOW;
+    for (int bit = 0; bit < 32 && firstPin + bit < PIN_COUNT; bit++)
+    {
+        if (value & (1UL << bit))
+        {
+            PIN_VALUES[firstPin + bit] = level;
+        }
+    }
+    GPIO_WRITES++;
+}
+
+uint32_t simGetGpioWriteCount()
+{
+    return GPIO_WRITES;
+}
+
+int simGetDigitalOutput(uint8_t pin)
+{
+    return PIN_VALUES[pin % PIN_COUNT];
+}
+
+/**
+ * Serial
+ */
+
+size_t Print::print(const String &str)
+{
+    return write(reinterpret_cast<const uint8_t *>(str.c_str()), str.length());
+}
+
+size_t Print::print(const char *str)
+{
+    return write(reinterpret_cast<const uint8_t *>(str), strlen(str));
+}
+
+size_t Print::print(char c)
+{
+    return write(reinterpret_cast<const uint8_t *>(&c), 1);
+}
+
+size_t Print::print(int number, int base) { return print(String(number, base)); }
+size_t Print::print(unsigned int number, int base) { return print(String(number, base)); }
+size_t Print::print(long number, int base) { return print(String(number, base)); }
+size_t Print::print(unsigned long number, int base) { return print(String(number, base)); }
+size_t Print::print(double number, int decimals) { return print(String(number, decimals)); }
+
+size_t Print::println()
+{
+    return print("\r\n");
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0)
+    {
+        return 0;
+    }
+    return write(reinterpret_cast<const uint8_t *>(buffer), std::min<size_t>(len, sizeof(buffer) - 1));
+}
+
+static std::atomic<bool> serialEnabled(true);
+
+void simSetSerialEnabled(bool enabled)
+{
+    serialEnabled = enabled;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (!serialEnabled)
+    {
+        return size;
+    }
+    return fwrite(buffer, 1, size, stdout);
+}
+
+/**
+ * ESP
+ */
+
+uint32_t EspClass::getFreeHeap()
+{
+#ifdef __GLIBC__
+    return mallinfo2().fordblks;
+#else
+    return 0;
+#endif
+}
+
+uint64_t EspClass::getEfuseMac()
+{
+    return 0;
+}
+
+void EspClass::restart()
+{
+    Serial.println("ESP.restart(), exiting");
+    fflush(stdout);
+    exit(0);
+}
+
+/**
+ * WiFi
+ */
+
+bool WiFiClass::mode(wifi_mode_t mode)
+{
+    currentMode = mode;
+    return true;
+}
+
+wifi_mode_t WiFiClass::getMode()
+{
+    return currentMode;
+}
+
+bool WiFiClass::softAP(const String &ssid, const String &password)
+{
+    return true;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *password)
+{
+    currentStatus = WL_CONNECTED;
+    return currentStatus;
+}
+
+wl_status_t WiFiClass::status()
+{
+    return currentStatus;
+}
+
+/**
+ * Preferences
+ */
+
+static std::map<String, String> &preferenceStore()
+{
+    static std::map<String, String> store;
+    return store;
+}
+
+static std::atomic<unsigned long> preferenceWriteDelayUs(0);
+static std::atomic<unsigned long> preferenceReadDelayUs(0);
+
+void simSetPreferenceWriteDelay(unsigned long us)
+{
+    preferenceWriteDelayUs = us;
+}
+
+void simSetPreferenceReadDelay(unsigned long us)
+{
+    preferenceReadDelayUs = us;
+}
+
+static void simulatePreferenceRead()
+{
+    if (preferenceReadDelayUs > 0)
+    {
+        delayMicroseconds(preferenceReadDelayUs);
+    }
+}
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+    ns = String(name) + "/";
+    started = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    started = false;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    simulatePreferenceRead();
+    std::lock_guard<std::mutex> lock(simMutex);
+    return preferenceStore().count(ns + key) > 0;
+}
+
+bool Preferences::remove(const char *key)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    return preferenceStore().erase(ns + key) > 0;
+}
+
+bool Preferences::clear()
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    std::map<String, String> &store = preferenceStore();
+    for (auto it = store.begin(); it != store.end();)
+    {
+        it = it->first.startsWith(ns) ? store.erase(it) : std::next(it);
+    }
+    return true;
+}
+
+size_t Preferences::putString(const char *key, const char *value)
+{
+    return putString(key, String(value));
+}
+
+size_t Preferences::putString(const char *key, const String &value)
+{
+    if (!started)
+    {
+        return 0;
+    }
+    if (preferenceWriteDelayUs > 0)
+    {
+        delayMicroseconds(preferenceWriteDelayUs);
+    }
+    std::lock_guard<std::mutex> lock(simMutex);
+    preferenceStore()[ns + key] = value;
+    return value.length();
+}
+
+String Preferences::getString(const char *key, const String &defaultValue)
+{
+    simulatePreferenceRead();
+    std::lock_guard<std::mutex> lock(simMutex);
+    std::map<String, String> &store = preferenceStore();
+    auto it = store.find(ns + key);
+    return it == store.end() ? defaultValue : it->second;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    return putString(key, String(static_cast<const char *>(value), length));
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    simulatePreferenceRead();
+    std::lock_guard<std::mutex> lock(simMutex);
+    std::map<String, String> &store = preferenceStore();
+    auto it = store.find(ns + key);
+    return it == store.end() ? 0 : it->second.length();
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t maxLength)
+{
+    simulatePreferenceRead();
+    std::lock_guard<std::mutex> lock(simMutex);
+    std::map<String, String> &store = preferenceStore();
+    auto it = store.find(ns + key);
+    if (it == store.end() || it->second.length() > maxLength)
+    {
+        return 0;
+    }
+    memcpy(buffer, it->second.c_str(), it->second.length());
+    return it->second.length();
+}
+
+/**
+ * CRC
+ */
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buffer, uint32_t length)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        crc ^= buffer[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * Sensors
+ */
+
+void simSetAht20(float temperature, float humidity, bool connected)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    ahtTemperature = temperature;
+    ahtHumidity = humidity;
+    ahtConnected = connected;
+}
+
+void simSetProbeTemperature(float temperature, int index)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    PROBE_TEMPERATURES[index % SIM_MAX_PROBES] = temperature;
+}
+
+void simSetProbeCount(int count)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    for (int i = 0; i < SIM_MAX_PROBES; i++)
+    {
+        PROBE_CONNECTED[i] = i < count;
+    }
+}
+
+void simSetProbeConnected(int index, bool connected)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    PROBE_CONNECTED[index % SIM_MAX_PROBES] = connected;
+}
+
+/**
+ * I2C, only the AHT20 is on the bus
+ */
+
+constexpr uint8_t AHT20_SIM_ADDRESS = 0x38;
+constexpr unsigned long AHT20_SIM_CONVERSION_MS = 80;
+
+static bool ahtCalibrated = true;
+static bool ahtMeasuring = false;
+static unsigned long ahtTriggeredMs = 0;
+
+TwoWire Wire;
+
+static uint8_t ahtCrc8(const uint8_t *data, size_t length)
+{
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency)
+{
+    return true;
+}
+
+bool TwoWire::setClock(uint32_t frequency)
+{
+    return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    this->address = address;
+    transmitBuffer.clear();
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    transmitBuffer.push_back(data);
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t length)
+{
+    transmitBuffer.insert(transmitBuffer.end(), data, data + length);
+    return length;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    if (address != AHT20_SIM_ADDRESS || !ahtConnected)
+    {
+        return 2;
+    }
+    if (!transmitBuffer.empty())
+    {
+        switch (transmitBuffer[0])
+        {
+        case 0xBA:
+            ahtMeasuring = false;
+            break;
+        case 0xBE:
+            ahtCalibrated = true;
+            break;
+        case 0xAC:
+            ahtMeasuring = true;
+            ahtTriggeredMs = millis();
+            break;
+        }
+    }
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    receiveBuffer.clear();
+    receiveIndex = 0;
+    if (address != AHT20_SIM_ADDRESS || !ahtConnected)
+    {
+        return 0;
+    }
+    bool busy = ahtMeasuring && millis() - ahtTriggeredMs < AHT20_SIM_CONVERSION_MS;
+    uint32_t humidity = constrain(ahtHumidity, 0.0f, 100.0f) / 100 * 0xFFFFF;
+    uint32_t temperature = (constrain(ahtTemperature, -50.0f, 150.0f) + 50) / 200 * 0xFFFFF;
+    uint8_t data[7] = {
+        static_cast<uint8_t>((busy ? 0x80 : 0) | (ahtCalibrated ? 0x08 : 0)),
+        static_cast<uint8_t>(humidity >> 12),
+        static_cast<uint8_t>(humidity >> 4),
+        static_cast<uint8_t>(((humidity & 0x0F) << 4) | (temperature >> 16)),
+        static_cast<uint8_t>(temperature >> 8),
+        static_cast<uint8_t>(temperature),
+        0};
+    data[6] = ahtCrc8(data, 6);
+    receiveBuffer.assign(data, data + min<size_t>(quantity, sizeof(data)));
+    return receiveBuffer.size();
+}
+
+int TwoWire::available()
+{
+    return receiveBuffer.size() - receiveIndex;
+}
+
+int TwoWire::read()
+{
+    return receiveIndex < receiveBuffer.size() ? receiveBuffer[receiveIndex++] : -1;
+}
+
+/**
+ * Family code 0x28, the index as serial number and the crc left 0
+ */
+static bool isSimProbeAddress(const uint8_t *address)
+{
+    return address[0] == 0x28 && address[1] < SIM_MAX_PROBES && PROBE_CONNECTED[address[1]];
+}
+
+static void finishProbeConversion()
+{
+    if (probeConverting && millis() - probeConversionMs >= PROBE_SIM_CONVERSION_MS)
+    {
+        memcpy(CONVERTED_TEMPERATURES, CONVERTING_TEMPERATURES, sizeof(CONVERTED_TEMPERATURES));
+        probeConverting = false;
+    }
+}
+
+void DallasTemperature::begin()
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    static bool poweredOn = false;
+    if (!poweredOn)
+    {
+        for (float &temperature : CONVERTED_TEMPERATURES)
+        {
+            temperature = PROBE_SIM_POWER_ON_TEMPERATURE;
+        }
+        poweredOn = true;
+    }
+}
+
+uint8_t DallasTemperature::getDeviceCount()
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    uint8_t count = 0;
+    for (bool connected : PROBE_CONNECTED)
+    {
+        count += connected;
+    }
+    return count;
+}
+
+bool DallasTemperature::getAddress(uint8_t *address, uint8_t index)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    // the index-th connected probe, in the order a search finds them
+    for (uint8_t probe = 0; probe < SIM_MAX_PROBES; probe++)
+    {
+        if (PROBE_CONNECTED[probe] && index-- == 0)
+        {
+            uint8_t simAddress[8] = {0x28, probe, 0, 0, 0, 0, 0, 0};
+            memcpy(address, simAddress, sizeof(simAddress));
+            return true;
+        }
+    }
+    return false;
+}
+
+void DallasTemperature::setWaitForConversion(bool wait)
+{
+    waitForConversion = wait;
+}
+
+void DallasTemperature::requestTemperatures()
+{
+    {
+        std::lock_guard<std::mutex> lock(simMutex);
+        memcpy(CONVERTING_TEMPERATURES, PROBE_TEMPERATURES, sizeof(CONVERTING_TEMPERATURES));
+        probeConversionMs = millis();
+        probeConverting = true;
+    }
+    if (waitForConversion)
+    {
+        delay(PROBE_SIM_CONVERSION_MS);
+    }
+}
+
+int16_t DallasTemperature::millisToWaitForConversion()
+{
+    return PROBE_SIM_CONVERSION_MS;
+}
+
+float DallasTemperature::getTempC(const uint8_t *address)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    if (!isSimProbeAddress(address))
+    {
+        return DEVICE_DISCONNECTED_C;
+    }
+    finishProbeConversion();
+    return CONVERTED_TEMPERATURES[address[1]];
+}
+
+float DallasTemperature::getTempCByIndex(uint8_t index)
+{
+    DeviceAddress address;
+    return getAddress(address, index) ? getTempC(address) : DEVICE_DISCONNECTED_C;
+}
+
+/**
+ * Web server
+ */
+
+static AsyncWebServer *runningServer = nullptr;
+
+const AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post) const
+{
+    for (const AsyncWebParameter &param : _params)
+    {
+        if (param.name() == name && param.isPost() == post)
+        {
+            return &param;
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content)
+{
+    return new AsyncWebServerResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len)
+{
+    return new AsyncWebServerResponse(code, contentType, String(reinterpret_cast<const char *>(content), len));
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+    delete _response;
+    _response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content)
+{
+    send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServer::on(const char *uri, ArRequestHandlerFunction onRequest)
+{
+    on(uri, HTTP_ANY, onRequest);
+}
+
+void AsyncWebServer::on(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest)
+{
+    routes.push_back({uri, method, onRequest});
+}
+
+void AsyncWebServer::on(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload)
+{
+    // uploads never arrive through simRequest
+    on(uri, method, onRequest);
+}
+
+void AsyncWebServer::onNotFound(ArRequestHandlerFunction onRequest)
+{
+    notFound = onRequest;
+}
+
+void AsyncWebServer::begin()
+{
+    runningServer = this;
+}
+
+void AsyncWebServer::handle(AsyncWebServerRequest *request)
+{
+    for (const Route &route : routes)
+    {
+        if (route.uri == request->url() && (route.method & request->method()))
+        {
+            route.onRequest(request);
+            return;
+        }
+    }
+    if (notFound)
+    {
+        notFound(request);
+    }
+}
+
+SimResponse simRequest(WebRequestMethod method, const String &url, const std::map<String, String> &params)
+{
+    if (runningServer == nullptr)
+    {
+        return {0, String(), String(), {}};
+    }
+
+    std::vector<AsyncWebParameter> requestParams;
+    String path = url;
+    int query = url.indexOf('?');
+    if (query >= 0)
+    {
+        path = url.substring(0, query);
+        String rest = url.substring(query + 1);
+        while (rest.length() > 0)
+        {
+            int amp = rest.indexOf('&');
+            String pair = amp >= 0 ? rest.substring(0, amp) : rest;
+            rest = amp >= 0 ? rest.substring(amp + 1) : String();
+            int eq = pair.indexOf('=');
+            requestParams.emplace_back(eq >= 0 ? pair.substring(0, eq) : pair, eq >= 0 ? pair.substring(eq + 1) : String(), false);
+        }
+    }
+    for (const auto &param : params)
+    {
+        requestParams.emplace_back(param.first, param.second, true);
+    }
+
+    AsyncWebServerRequest request(method, path, requestParams);
+    runningServer->handle(&request);
+    const AsyncWebServerResponse *response = request.response();
+    if (response == nullptr)
+    {
+        return {500, String(), String(), {}};
+    }
+    return {response->code, response->contentType, response->content, response->headers};
+}
+
+/**
+ * Continuous ADC, samples are made up when they're read from the time conversions have been running
+ */
+
+static bool adcInitialized = false;
+static bool adcRunning = false;
+static uint32_t adcStoreBytes = 0;
+static std::vector<adc_digi_pattern_config_t> adcPattern;
+static uint32_t adcSampleFreqHz = 0;
+static uint64_t adcStartUs = 0;
+static uint64_t adcStopUs = 0;
+// conversions done since the start that have been read or dropped
+static uint64_t adcTakenSamples = 0;
+
+esp_err_t adc_digi_initialize(const adc_digi_init_config_t *init_config)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    if (init_config->adc2_chan_mask != 0)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    adcStoreBytes = init_config->max_store_buf_size;
+    adcInitialized = true;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_deinitialize(void)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    adcInitialized = false;
+    adcRunning = false;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t *config)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    if (!adcInitialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->pattern_num == 0 || config->sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW ||
+        config->sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH || config->conv_mode != ADC_CONV_SINGLE_UNIT_1)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    adcPattern.assign(config->adc_pattern, config->adc_pattern + config->pattern_num);
+    adcSampleFreqHz = config->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_start(void)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    if (!adcInitialized || adcPattern.empty())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    adcStartUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START).count();
+    adcTakenSamples = 0;
+    adcRunning = true;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_stop(void)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    if (adcRunning)
+    {
+        adcStopUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START).count();
+    }
+    adcRunning = false;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_read_bytes(uint8_t *buf, uint32_t length_max, uint32_t *out_length, uint32_t timeout_ms)
+{
+    std::lock_guard<std::mutex> lock(simMutex);
+    *out_length = 0;
+    if (!adcInitialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // what was converted before a stop can still be read
+    uint64_t end = adcRunning ? std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START).count() : adcStopUs;
+    uint64_t converted = end > adcStartUs ? (end - adcStartUs) * adcSampleFreqHz / 1000000 : 0;
+    // like the driver's ring buffer, whatever doesn't fit in the store is lost
+    uint64_t storeSamples = adcStoreBytes / sizeof(adc_digi_output_data_t);
+    if (converted - adcTakenSamples > storeSamples)
+    {
+        adcTakenSamples = converted - storeSamples;
+    }
+    uint32_t count = min<uint64_t>(converted - adcTakenSamples, length_max / sizeof(adc_digi_output_data_t));
+    adc_digi_output_data_t *out = reinterpret_cast<adc_digi_output_data_t *>(buf);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint64_t sample = adcTakenSamples + i;
+        const adc_digi_pattern_config_t &entry = adcPattern[sample % adcPattern.size()];
+        uint64_t sampleUs = adcStartUs + sample * 1000000 / adcSampleFreqHz;
+        out[i].type1.channel = entry.channel;
+        out[i].type1.data = entry.channel < ADC1_CHANNEL_COUNT ? sampleAnalog(ADC1_PINS[entry.channel], sampleUs) : 0;
+    }
+    adcTakenSamples += count;
+    *out_length = count * sizeof(adc_digi_output_data_t);
+    return count > 0 ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * esp_timer, one thread runs every callback in deadline order
+ */
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    int64_t deadline;
+    bool active;
+};
+
+// never destroyed, the timer thread is still waiting on them when the process exits
+static std::mutex &timerMutex = *new std::mutex;
+static std::condition_variable &timerChanged = *new std::condition_variable;
+static std::vector<esp_timer *> TIMERS;
+
+static void runTimers()
+{
+    std::unique_lock<std::mutex> lock(timerMutex);
+    while (true)
+    {
+        esp_timer *next = nullptr;
+        for (esp_timer *timer : TIMERS)
+        {
+            if (timer->active && (next == nullptr || timer->deadline < next->deadline))
+            {
+                next = timer;
+            }
+        }
+        if (next == nullptr)
+        {
+            timerChanged.wait(lock);
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        if (now < next->deadline)
+        {
+            timerChanged.wait_for(lock, std::chrono::microseconds(next->deadline - now));
+            continue;
+        }
+        next->active = false;
+        lock.unlock();
+        next->callback(next->arg);
+        lock.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if (TIMERS.empty())
+    {
+        std::thread(runTimers).detach();
+    }
+    esp_timer *timer = new esp_timer{create_args->callback, create_args->arg, 0, false};
+    TIMERS.push_back(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline = esp_timer_get_time() + timeout_us;
+    timer->active = true;
+    timerChanged.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if (!timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    timerChanged.notify_all();
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> lock(timerMutex);
+    return timer->active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START).count();
+}
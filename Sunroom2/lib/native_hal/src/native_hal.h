@@ -0,0 +1,78 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <map>
+
+/**
+ * Simulation hooks for the native build, the firmware never includes this.
+ * The default simulation (native_main.cpp) drives these from the wall clock.
+ */
+
+/**
+ * Turn Serial output off, e.g. so a benchmark doesn't time printing
+ */
+void simSetSerialEnabled(bool enabled);
+
+/**
+ * Make every Preferences::putString take this long, NVS writes on the device are
+ * milliseconds and the in-memory store hides that from latency measurements
+ */
+void simSetPreferenceWriteDelay(unsigned long us);
+
+/**
+ * Make every Preferences call that reads the store take this long
+ */
+void simSetPreferenceReadDelay(unsigned long us);
+
+void simSetDigitalInput(uint8_t pin, int value);
+void simSetAnalogInput(uint8_t pin, uint16_t value);
+
+/**
+ * Add a sine of amplitude and periodMs and up to noise counts of random noise around the
+ * pin's analog input, every analogRead and continuous ADC sample sees it
+ */
+void simSetAnalogWaveform(uint8_t pin, uint16_t amplitude, unsigned long periodMs, uint16_t noise);
+
+/**
+ * Last value written with digitalWrite or the gpio output registers
+ */
+int simGetDigitalOutput(uint8_t pin);
+
+/**
+ * digitalWrite calls and gpio output register writes so far
+ */
+uint32_t simGetGpioWriteCount();
+
+/**
+ * What the AHT20 reports, an unreachable sensor doesn't acknowledge on the bus
+ */
+void simSetAht20(float temperature, float humidity, bool connected = true);
+
+/**
+ * What a DS18B20 probe reports, and how many probes are on the bus (1 to start with).
+ * simSetProbeConnected plugs or unplugs one probe, the others keep their addresses.
+ */
+void simSetProbeTemperature(float temperature, int index = 0);
+void simSetProbeCount(int count);
+void simSetProbeConnected(int index, bool connected);
+
+/**
+ * What an HTTPClient GET of url answers, after taking delayMs. Urls without a response fail
+ * like a dropped connection.
+ */
+void simSetHttpResponse(const String &url, int code, const String &body, unsigned long delayMs = 0);
+
+struct SimResponse
+{
+    int code;
+    String contentType;
+    String body;
+    std::map<String, String> headers;
+};
+
+/**
+ * Dispatch a request to the handlers registered on the AsyncWebServer, as if it came in over http.
+ * A query string in the url becomes GET params, params become POST params.
+ * Returns code 0 if no server has been started.
+ */
+SimResponse simRequest(WebRequestMethod method, const String &url, const std::map<String, String> &params = {});
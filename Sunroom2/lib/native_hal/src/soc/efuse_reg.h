@@ -0,0 +1,2 @@
+#pragma once
+// The efuse mac comes from ESP.getEfuseMac() in the native build
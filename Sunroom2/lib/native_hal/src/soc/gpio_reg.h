@@ -0,0 +1,7 @@
+#pragma once
+
+// ESP32 gpio output registers, writing 1 bits sets or clears those pins' outputs
+#define GPIO_OUT_W1TS_REG 0x3FF44008
+#define GPIO_OUT_W1TC_REG 0x3FF4400C
+#define GPIO_OUT1_W1TS_REG 0x3FF44014
+#define GPIO_OUT1_W1TC_REG 0x3FF44018
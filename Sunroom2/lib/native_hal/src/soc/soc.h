@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Register writes go to the simulated peripherals, only the ones in gpio_reg.h are known
+ */
+void simRegisterWrite(uint32_t reg, uint32_t value);
+
+#define REG_WRITE(reg, value) simRegisterWrite((reg), (value))
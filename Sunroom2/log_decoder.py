@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Turns the binary dump from GET /logs (see src/logger.cpp) back into log lines.
+
+    python3 log_decoder.py http://barn.local/logs
+    curl -s http://barn.local/logs | python3 log_decoder.py
+"""
+import re
+import struct
+import sys
+import urllib.request
+
+LEVELS = "DIWE"
+SPEC = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)[hlLqjzt]*([a-zA-Z%])")
+
+ARG_INT32, ARG_UINT32, ARG_INT64, ARG_UINT64, ARG_FLOAT, ARG_DOUBLE, ARG_STRING = range(1, 8)
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def done(self):
+        return self.pos >= len(self.data)
+
+    def take(self, fmt):
+        values = struct.unpack_from("<" + fmt, self.data, self.pos)
+        self.pos += struct.calcsize("<" + fmt)
+        return values if len(values) > 1 else values[0]
+
+    def bytes(self, size):
+        out = self.data[self.pos:self.pos + size]
+        self.pos += size
+        return out
+
+
+def decode_args(data):
+    args = []
+    reader = Reader(data)
+    while not reader.done():
+        kind = reader.take("B")
+        if kind == ARG_INT32:
+            args.append(reader.take("i"))
+        elif kind == ARG_UINT32:
+            args.append(reader.take("I"))
+        elif kind == ARG_INT64:
+            args.append(reader.take("q"))
+        elif kind == ARG_UINT64:
+            args.append(reader.take("Q"))
+        elif kind == ARG_FLOAT:
+            args.append(reader.take("f"))
+        elif kind == ARG_DOUBLE:
+            args.append(reader.take("d"))
+        elif kind == ARG_STRING:
+            args.append(reader.bytes(reader.take("B")).decode("utf-8", "replace"))
+        else:
+            break
+    return args
+
+
+def format_message(fmt, args):
+    """Same rules as formatMessage() in logger.cpp"""
+    args = list(args)
+
+    def convert(match):
+        flags, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if not args:
+            return match.group(0)
+        value = args.pop(0)
+        if isinstance(value, str):
+            return ("%" + flags + "s") % value
+        if isinstance(value, float):
+            return ("%" + flags + (conversion if conversion in "fFeEgG" else "g")) % value
+        if conversion == "c":
+            return ("%" + flags + "c") % value
+        if conversion not in "diouxX":
+            conversion = "d"
+        return ("%" + flags + conversion) % value
+
+    return SPEC.sub(convert, fmt)
+
+
+def decode(data):
+    reader = Reader(data)
+    if reader.bytes(4) != b"SLOG":
+        raise ValueError("not a log dump")
+    version, dropped, now = reader.take("BII")
+    if version != 1:
+        raise ValueError("unsupported log dump version %d" % version)
+
+    formats = {}
+    lines = []
+    while not reader.done():
+        kind = reader.bytes(1)
+        if kind == b"F":
+            format_id, level, line = reader.take("HBH")
+            file = reader.bytes(reader.take("B")).decode()
+            fmt = reader.bytes(reader.take("H")).decode("utf-8", "replace")
+            formats[format_id] = (level, line, file, fmt)
+        elif kind == b"R":
+            format_id, timestamp, _argc, size = reader.take("HIBH")
+            level, line, file, fmt = formats[format_id]
+            message = format_message(fmt, decode_args(reader.bytes(size)))
+            lines.append("[%8u][%s] %s:%u %s" % (timestamp, LEVELS[level % 4], file, line, message))
+        else:
+            raise ValueError("corrupt log dump at byte %d" % (reader.pos - 1))
+
+    lines.append("-- uptime %u ms, %u records dropped" % (now, dropped))
+    return lines
+
+
+def main():
+    if len(sys.argv) > 1 and sys.argv[1].startswith("http"):
+        data = urllib.request.urlopen(sys.argv[1]).read()
+    elif len(sys.argv) > 1:
+        with open(sys.argv[1], "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+    for line in decode(data):
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
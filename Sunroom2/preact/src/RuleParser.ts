@@ -82,12 +82,32 @@ const SENSOR_TYPES = [
     name: 'lightSwitch',
     dataType: 'bool',
   },
+  {
+    name: 'probeTemperature_0',
+    dataType: 'int', // -55 - 125
+  },
+  {
+    name: 'probeTemperature_1',
+    dataType: 'int', // -55 - 125
+  },
+  {
+    name: 'probeTemperature_2',
+    dataType: 'int', // -55 - 125
+  },
+  {
+    name: 'probeTemperature_3',
+    dataType: 'int', // -55 - 125
+  },
 ] as const;
 
 /**
- * Actuators available on the device.
+ * Actuators available on the device, numbered from 0 like the firmware's relays.
  */
 const ACTUATOR_TYPES = [
+  {
+    name: 'relay_0',
+    dataType: 's_bool',
+  },
   {
     name: 'relay_1',
     dataType: 's_bool',
@@ -116,10 +136,6 @@ const ACTUATOR_TYPES = [
     name: 'relay_7',
     dataType: 's_bool',
   },
-  {
-    name: 'relay_8',
-    dataType: 's_bool',
-  },
 ] as const;
 
 type ValidationFunc = (...args: DataType[]) => boolean;
@@ -147,16 +163,18 @@ const FUNCTION_TYPES = [
   {
     name: 'AND',
     args: 2,
+    variadic: true,
     returnType: 'bool',
-    validateArgs: ((a: DataType, b: DataType) =>
-      a === 'bool' && b === 'bool') as ValidationFunc,
+    validateArgs: ((...types: DataType[]) =>
+      types.every((t) => t === 'bool')) as ValidationFunc,
   },
   {
     name: 'OR',
     args: 2,
+    variadic: true,
     returnType: 'bool',
-    validateArgs: ((a: DataType, b: DataType) =>
-      a === 'bool' && b === 'bool') as ValidationFunc,
+    validateArgs: ((...types: DataType[]) =>
+      types.every((t) => t === 'bool')) as ValidationFunc,
   },
   {
     name: 'NOT',
@@ -372,10 +390,13 @@ const recursivelyValidateFunctions = (
 
   const funcData = FUNCTION_TYPES.find((f) => f.name === funcName.name);
 
-  if (args.length !== funcData.args) {
+  const variadic = 'variadic' in funcData && funcData.variadic;
+  if (
+    variadic ? args.length < funcData.args : args.length !== funcData.args
+  ) {
     return {
       type: 'ERROR',
-      message: `Expected ${funcData.args} arguments for function "${funcName.name}" at path ${pathStr}`,
+      message: `Expected ${variadic ? 'at least ' : ''}${funcData.args} arguments for function "${funcName.name}" at path ${pathStr}`,
       index: 0,
     };
   }
@@ -0,0 +1,323 @@
+#include <Arduino.h>
+#include <driver/adc.h>
+#include "job_scheduler.h"
+#include "adc_sampler.h"
+#include "logger.h"
+
+constexpr uint32_t ADC_SAMPLE_FREQ_HZ = 20000;
+/**
+ * A burst covers a whole period of the 100Hz flicker of mains lighting, so oversampling a
+ * burst's worth of samples averages the flicker out
+ */
+constexpr uint32_t ADC_BURST_MS = 10;
+/**
+ * Conversions per DMA interrupt, bursts are rounded up to whole frames
+ */
+constexpr uint32_t ADC_FRAME_SAMPLES = 50;
+constexpr uint32_t ADC_BUFFER_SAMPLES = 256;
+constexpr uint32_t ADC_BURST_MARGIN_MS = 1;
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+constexpr adc_digi_output_format_t ADC_OUTPUT_FORMAT = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+static uint8_t sampleChannel(const adc_digi_output_data_t &sample) { return sample.type2.channel; }
+static uint16_t sampleData(const adc_digi_output_data_t &sample) { return sample.type2.data; }
+#else
+constexpr adc_digi_output_format_t ADC_OUTPUT_FORMAT = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+static uint8_t sampleChannel(const adc_digi_output_data_t &sample) { return sample.type1.channel; }
+static uint16_t sampleData(const adc_digi_output_data_t &sample) { return sample.type1.data; }
+#endif
+
+struct AdcPin
+{
+    uint8_t pin;
+    /**
+     * ADC1 channel, -1 for a pin read with analogRead
+     */
+    int8_t channel;
+    AdcFilter filter;
+    AdcReadingCallback callback;
+    /**
+     * Raw samples toward the next oversampled value
+     */
+    uint32_t sum;
+    uint8_t summed;
+    /**
+     * Ring of the last medianWindow oversampled values
+     */
+    float window[ADC_MAX_MEDIAN_WINDOW];
+    uint8_t windowCount;
+    uint8_t windowNext;
+    bool hasReading;
+    bool updated;
+    AdcReading reading;
+};
+
+static AdcPin PINS[ADC_MAX_PINS];
+static int pinCount = 0;
+static adc_digi_output_data_t BUFFER[ADC_BUFFER_SAMPLES];
+
+static bool dma = false;
+static bool sampling = false;
+static int adcJob = NO_JOB;
+static unsigned long burstIntervalMs = 0;
+static unsigned long burstStartMs = 0;
+static uint32_t burstUs = 0;
+static uint32_t burstMs = 0;
+static AdcSamplerStats stats = {};
+
+bool adcSamplerAddPin(uint8_t pin, AdcFilter filter, AdcReadingCallback callback)
+{
+    if (pinCount >= ADC_MAX_PINS)
+    {
+        return false;
+    }
+    filter.oversampling = max<uint8_t>(filter.oversampling, 1);
+    filter.medianWindow = constrain(filter.medianWindow | 1, 1, ADC_MAX_MEDIAN_WINDOW);
+    filter.emaWeight = constrain(filter.emaWeight, 0.01f, 1.0f);
+    AdcPin &entry = PINS[pinCount++];
+    entry = {};
+    entry.pin = pin;
+    // the core numbers ADC2 channels after ADC1's, only ADC1 runs continuously
+    int8_t channel = digitalPinToAnalogChannel(pin);
+    entry.channel = channel >= 0 && channel < ADC1_CHANNEL_MAX ? channel : -1;
+    entry.filter = filter;
+    entry.callback = callback;
+    entry.reading.pin = pin;
+    return true;
+}
+
+static float median(const AdcPin &entry)
+{
+    float sorted[ADC_MAX_MEDIAN_WINDOW];
+    int count = entry.windowCount;
+    for (int i = 0; i < count; i++)
+    {
+        float value = entry.window[i];
+        int at = i;
+        while (at > 0 && sorted[at - 1] > value)
+        {
+            sorted[at] = sorted[at - 1];
+            at--;
+        }
+        sorted[at] = value;
+    }
+    return count % 2 == 1 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+static void addFilteredValue(AdcPin &entry, float value)
+{
+    entry.window[entry.windowNext] = value;
+    entry.windowNext = (entry.windowNext + 1) % entry.filter.medianWindow;
+    entry.windowCount = min<uint8_t>(entry.windowCount + 1, entry.filter.medianWindow);
+
+    float filtered = median(entry);
+    AdcReading &reading = entry.reading;
+    reading.value = entry.hasReading ? reading.value + entry.filter.emaWeight * (filtered - reading.value) : filtered;
+    reading.unfiltered = value;
+    entry.hasReading = true;
+    entry.updated = true;
+}
+
+static void addSample(AdcPin &entry, uint16_t raw)
+{
+    stats.samples++;
+    entry.sum += raw;
+    if (++entry.summed == entry.filter.oversampling)
+    {
+        addFilteredValue(entry, static_cast<float>(entry.sum) / entry.summed);
+        entry.sum = 0;
+        entry.summed = 0;
+    }
+}
+
+static AdcPin *findChannel(uint8_t channel)
+{
+    for (int i = 0; i < pinCount; i++)
+    {
+        if (PINS[i].channel == channel)
+        {
+            return &PINS[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Set up the DMA driver for every pin on ADC1, false if there are none or it won't start
+ */
+static bool startDma()
+{
+    adc_digi_pattern_config_t pattern[ADC_MAX_PINS];
+    uint32_t patternCount = 0;
+    uint32_t channelMask = 0;
+    for (int i = 0; i < pinCount; i++)
+    {
+        if (PINS[i].channel < 0)
+        {
+            continue;
+        }
+        pattern[patternCount++] = {ADC_ATTEN_DB_11, static_cast<uint8_t>(PINS[i].channel), 0, SOC_ADC_DIGI_MAX_BITWIDTH};
+        channelMask |= 1 << PINS[i].channel;
+    }
+    if (patternCount == 0)
+    {
+        return false;
+    }
+
+    // the pattern goes round the pins, each gets an equal share of the burst
+    uint32_t samples = ADC_BURST_MS * ADC_SAMPLE_FREQ_HZ / 1000;
+    samples = (samples + ADC_FRAME_SAMPLES - 1) / ADC_FRAME_SAMPLES * ADC_FRAME_SAMPLES;
+    burstMs = (samples * 1000 + ADC_SAMPLE_FREQ_HZ - 1) / ADC_SAMPLE_FREQ_HZ + ADC_BURST_MARGIN_MS;
+
+    adc_digi_init_config_t init = {};
+    // room for the whole burst, it is read out after the conversions stop
+    init.max_store_buf_size = samples * sizeof(adc_digi_output_data_t);
+    init.conv_num_each_intr = ADC_FRAME_SAMPLES * sizeof(adc_digi_output_data_t);
+    init.adc1_chan_mask = channelMask;
+    init.adc2_chan_mask = 0;
+    esp_err_t err = adc_digi_initialize(&init);
+    if (err != ESP_OK)
+    {
+        LOG_WARN("Continuous ADC unavailable: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = false;
+    config.pattern_num = patternCount;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = ADC_SAMPLE_FREQ_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_OUTPUT_FORMAT;
+    err = adc_digi_controller_configure(&config);
+    if (err != ESP_OK)
+    {
+        LOG_WARN("Continuous ADC unavailable: %s", esp_err_to_name(err));
+        adc_digi_deinitialize();
+        return false;
+    }
+    return true;
+}
+
+static void collectDma()
+{
+    // stop first so what is read is exactly this burst, the driver keeps it for reading
+    adc_digi_stop();
+    uint32_t length = 0;
+    while (adc_digi_read_bytes(reinterpret_cast<uint8_t *>(BUFFER), sizeof(BUFFER), &length, 0) == ESP_OK && length > 0)
+    {
+        uint32_t count = length / sizeof(adc_digi_output_data_t);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            AdcPin *entry = findChannel(sampleChannel(BUFFER[i]));
+            if (entry == nullptr)
+            {
+                stats.droppedSamples++;
+                continue;
+            }
+            addSample(*entry, sampleData(BUFFER[i]));
+        }
+    }
+}
+
+/**
+ * Pins the burst didn't cover get one group of analogRead calls
+ */
+static void readWithoutDma(bool dmaRan)
+{
+    for (int i = 0; i < pinCount; i++)
+    {
+        AdcPin &entry = PINS[i];
+        if (dmaRan && entry.channel >= 0)
+        {
+            continue;
+        }
+        for (int sample = 0; sample < entry.filter.oversampling; sample++)
+        {
+            addSample(entry, analogRead(entry.pin));
+        }
+    }
+}
+
+static void publishReadings()
+{
+    uint32_t now = millis();
+    for (int i = 0; i < pinCount; i++)
+    {
+        AdcPin &entry = PINS[i];
+        if (entry.updated)
+        {
+            entry.updated = false;
+            entry.reading.timestampMs = now;
+            entry.callback(entry.reading);
+        }
+    }
+}
+
+static void finishBurst(uint32_t stepUs)
+{
+    burstUs += stepUs;
+    stats.bursts++;
+    stats.lastBurstUs = burstUs;
+    stats.maxBurstUs = max(stats.maxBurstUs, burstUs);
+    publishReadings();
+
+    // keep the interval between burst starts
+    unsigned long elapsed = millis() - burstStartMs;
+    scheduleJob(adcJob, elapsed < burstIntervalMs ? burstIntervalMs - elapsed : 0);
+}
+
+/**
+ * Alternates between starting a burst and collecting it
+ */
+static void adcStep()
+{
+    uint32_t start = micros();
+    if (!sampling)
+    {
+        burstStartMs = millis();
+        burstUs = 0;
+        if (dma && adc_digi_start() == ESP_OK)
+        {
+            sampling = true;
+            burstUs = micros() - start;
+            scheduleJob(adcJob, burstMs);
+            return;
+        }
+        readWithoutDma(false);
+        finishBurst(micros() - start);
+        return;
+    }
+
+    sampling = false;
+    collectDma();
+    readWithoutDma(true);
+    finishBurst(micros() - start);
+}
+
+void adcSamplerSetup(unsigned long intervalMs)
+{
+    burstIntervalMs = intervalMs;
+    dma = startDma();
+    stats.dma = dma;
+    LOG_INFO("ADC sampling %d pins every %lums, dma %d", pinCount, intervalMs, dma);
+    adcJob = addOneShotJob("adc", adcStep, 0);
+}
+
+bool getAdcReading(uint8_t pin, AdcReading &reading)
+{
+    for (int i = 0; i < pinCount; i++)
+    {
+        if (PINS[i].pin == pin && PINS[i].hasReading)
+        {
+            reading = PINS[i].reading;
+            return true;
+        }
+    }
+    return false;
+}
+
+AdcSamplerStats getAdcSamplerStats()
+{
+    return stats;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Background sampling of analog pins. Every interval a job starts the continuous (DMA) ADC
+ * for a 10ms burst, comes back when the burst should be done and filters what came in, so
+ * the loop never waits on a conversion. Each pin's raw samples are averaged in groups of
+ * oversampling, run through a median of the last medianWindow averages to drop spikes and
+ * then through an exponential moving average. The ADC runs at 20kHz and the pins share it.
+ *
+ * Pins that aren't on ADC1, or every pin if the DMA driver won't start, fall back to one
+ * group of analogRead calls per interval through the same filters.
+ */
+
+constexpr int ADC_MAX_PINS = 4;
+constexpr int ADC_MAX_MEDIAN_WINDOW = 9;
+
+struct AdcFilter
+{
+    /**
+     * Raw samples averaged into one value, a pin's share of a burst averages a whole burst.
+     * An average can span bursts, e.g. when the analogRead fallback reads fewer samples.
+     */
+    uint8_t oversampling;
+    /**
+     * Values the median is taken over, odd and at most ADC_MAX_MEDIAN_WINDOW, 1 turns it off
+     */
+    uint8_t medianWindow;
+    /**
+     * Weight of each new value in the moving average, 1 turns it off
+     */
+    float emaWeight;
+};
+
+struct AdcReading
+{
+    uint8_t pin;
+    /**
+     * Filtered value in raw ADC counts (0 - 4095)
+     */
+    float value;
+    /**
+     * Latest oversampled value before the median and moving average
+     */
+    float unfiltered;
+    /**
+     * millis() when the burst the reading came from was collected
+     */
+    uint32_t timestampMs;
+};
+
+/**
+ * Gets each pin's reading on the loop task after every burst
+ */
+typedef void (*AdcReadingCallback)(const AdcReading &reading);
+
+struct AdcSamplerStats
+{
+    /**
+     * 1 when the DMA driver is running the bursts
+     */
+    uint32_t dma;
+    uint32_t bursts;
+    uint32_t samples;
+    /**
+     * Samples that came in for a channel nobody asked for
+     */
+    uint32_t droppedSamples;
+    /**
+     * Time the job spent starting and collecting one burst, in us
+     */
+    uint32_t lastBurstUs;
+    uint32_t maxBurstUs;
+};
+
+/**
+ * Sample pin through filter, every pin has to be added before adcSamplerSetup.
+ * Returns false once ADC_MAX_PINS have been added.
+ */
+bool adcSamplerAddPin(uint8_t pin, AdcFilter filter, AdcReadingCallback callback);
+
+/**
+ * Start sampling every added pin every intervalMs
+ */
+void adcSamplerSetup(unsigned long intervalMs);
+
+/**
+ * The pin's latest reading, false if it isn't sampled or has no reading yet.
+ * Only call from the loop task.
+ */
+bool getAdcReading(uint8_t pin, AdcReading &reading);
+
+/**
+ * Safe to call from any task, the counters can be a burst apart
+ */
+AdcSamplerStats getAdcSamplerStats();
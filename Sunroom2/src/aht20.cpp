@@ -0,0 +1,229 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include "job_scheduler.h"
+#include "aht20.h"
+
+constexpr uint8_t AHT20_ADDRESS = 0x38;
+static const uint8_t AHT20_SOFT_RESET[] = {0xBA};
+static const uint8_t AHT20_CALIBRATE[] = {0xBE, 0x08, 0x00};
+static const uint8_t AHT20_TRIGGER[] = {0xAC, 0x33, 0x00};
+constexpr uint8_t AHT20_STATUS_BUSY = 0x80;
+constexpr uint8_t AHT20_STATUS_CALIBRATED = 0x08;
+// status, 5 bytes of humidity and temperature, crc
+constexpr uint8_t AHT20_READING_LENGTH = 7;
+
+// Datasheet timings
+constexpr unsigned long AHT20_POWER_ON_MS = 40;
+constexpr unsigned long AHT20_RESET_MS = 20;
+constexpr unsigned long AHT20_CALIBRATE_MS = 10;
+constexpr unsigned long AHT20_CONVERSION_MS = 80;
+
+// A conversion still running after AHT20_CONVERSION_MS is checked again this often
+constexpr unsigned long AHT20_BUSY_RETRY_MS = 10;
+constexpr int AHT20_BUSY_RETRIES = 5;
+
+constexpr uint32_t AHT20_FAILURES_BEFORE_RESET = 3;
+constexpr unsigned long AHT20_RETRY_MS = 1000;
+constexpr unsigned long AHT20_MAX_RETRY_MS = 5 * 60 * 1000;
+
+enum Aht20State : uint8_t
+{
+    AHT20_RESET,
+    AHT20_RESETTING,
+    AHT20_CALIBRATING,
+    AHT20_IDLE,
+    AHT20_MEASURING,
+};
+
+static Aht20State state = AHT20_RESET;
+static bool initialized = false;
+static int aht20Job = NO_JOB;
+static unsigned long readIntervalMs = 0;
+static Aht20ReadingCallback readingCallback = nullptr;
+static unsigned long triggeredMs = 0;
+static uint32_t triggeredUs = 0;
+static int busyRetries = 0;
+static Aht20Stats stats = {};
+
+static void countBusTime(uint32_t start)
+{
+    stats.maxBusUs = max(stats.maxBusUs, static_cast<uint32_t>(micros() - start));
+}
+
+static bool writeCommand(const uint8_t *command, size_t length)
+{
+    uint32_t start = micros();
+    Wire.beginTransmission(AHT20_ADDRESS);
+    Wire.write(command, length);
+    bool ok = Wire.endTransmission() == 0;
+    countBusTime(start);
+    return ok;
+}
+
+static bool readBytes(uint8_t *buffer, uint8_t length)
+{
+    uint32_t start = micros();
+    bool ok = Wire.requestFrom(AHT20_ADDRESS, length) == length;
+    for (uint8_t i = 0; ok && i < length; i++)
+    {
+        buffer[i] = Wire.read();
+    }
+    countBusTime(start);
+    return ok;
+}
+
+static uint8_t crc8(const uint8_t *data, size_t length)
+{
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * Retry soon after a single failed read, start over from a reset (backing off) once the
+ * sensor looks gone
+ */
+static void fail()
+{
+    stats.failures++;
+    stats.consecutiveFailures++;
+    if (stats.consecutiveFailures == AHT20_FAILURES_BEFORE_RESET)
+    {
+        readingCallback(false, 0, 0);
+    }
+    if (initialized && stats.consecutiveFailures < AHT20_FAILURES_BEFORE_RESET)
+    {
+        state = AHT20_IDLE;
+        scheduleJob(aht20Job, AHT20_RETRY_MS);
+        return;
+    }
+    initialized = false;
+    state = AHT20_RESET;
+    uint32_t doublings = min<uint32_t>(stats.consecutiveFailures - 1, 16);
+    scheduleJob(aht20Job, min(AHT20_RETRY_MS << doublings, AHT20_MAX_RETRY_MS));
+}
+
+static void triggerMeasurement()
+{
+    if (!writeCommand(AHT20_TRIGGER, sizeof(AHT20_TRIGGER)))
+    {
+        fail();
+        return;
+    }
+    triggeredMs = millis();
+    triggeredUs = micros();
+    busyRetries = 0;
+    state = AHT20_MEASURING;
+    scheduleJob(aht20Job, AHT20_CONVERSION_MS);
+}
+
+static void collectMeasurement()
+{
+    uint8_t data[AHT20_READING_LENGTH];
+    if (!readBytes(data, AHT20_READING_LENGTH))
+    {
+        fail();
+        return;
+    }
+    if (data[0] & AHT20_STATUS_BUSY)
+    {
+        if (busyRetries++ < AHT20_BUSY_RETRIES)
+        {
+            scheduleJob(aht20Job, AHT20_BUSY_RETRY_MS);
+            return;
+        }
+        fail();
+        return;
+    }
+    if (crc8(data, AHT20_READING_LENGTH - 1) != data[AHT20_READING_LENGTH - 1])
+    {
+        fail();
+        return;
+    }
+
+    // 20 bits each, humidity first and the two share the middle byte
+    uint32_t rawHumidity = (static_cast<uint32_t>(data[1]) << 12) | (static_cast<uint32_t>(data[2]) << 4) | (data[3] >> 4);
+    uint32_t rawTemperature = (static_cast<uint32_t>(data[3] & 0x0F) << 16) | (static_cast<uint32_t>(data[4]) << 8) | data[5];
+    float humidity = rawHumidity * 100.0f / 0x100000;
+    float temperature = rawTemperature * 200.0f / 0x100000 - 50;
+
+    uint32_t latency = micros() - triggeredUs;
+    stats.lastLatencyUs = latency;
+    stats.maxLatencyUs = max(stats.maxLatencyUs, latency);
+    stats.reads++;
+    stats.consecutiveFailures = 0;
+    state = AHT20_IDLE;
+    readingCallback(true, temperature, humidity);
+
+    // keep the interval between triggers rather than between results
+    unsigned long elapsed = millis() - triggeredMs;
+    scheduleJob(aht20Job, elapsed < readIntervalMs ? readIntervalMs - elapsed : 0);
+}
+
+/**
+ * Each run does one step and schedules the next one
+ */
+static void aht20Step()
+{
+    uint8_t status;
+    switch (state)
+    {
+    case AHT20_RESET:
+        stats.resets++;
+        if (!writeCommand(AHT20_SOFT_RESET, sizeof(AHT20_SOFT_RESET)))
+        {
+            fail();
+            return;
+        }
+        state = AHT20_RESETTING;
+        scheduleJob(aht20Job, AHT20_RESET_MS);
+        return;
+    case AHT20_RESETTING:
+    case AHT20_CALIBRATING:
+        if (!readBytes(&status, 1))
+        {
+            fail();
+            return;
+        }
+        if (!(status & AHT20_STATUS_CALIBRATED))
+        {
+            if (state == AHT20_CALIBRATING || !writeCommand(AHT20_CALIBRATE, sizeof(AHT20_CALIBRATE)))
+            {
+                fail();
+                return;
+            }
+            state = AHT20_CALIBRATING;
+            scheduleJob(aht20Job, AHT20_CALIBRATE_MS);
+            return;
+        }
+        initialized = true;
+        triggerMeasurement();
+        return;
+    case AHT20_IDLE:
+        triggerMeasurement();
+        return;
+    case AHT20_MEASURING:
+        collectMeasurement();
+        return;
+    }
+}
+
+void aht20Setup(unsigned long intervalMs, Aht20ReadingCallback callback)
+{
+    readIntervalMs = intervalMs;
+    readingCallback = callback;
+    Wire.begin();
+    aht20Job = addOneShotJob("aht20", aht20Step, AHT20_POWER_ON_MS);
+}
+
+Aht20Stats getAht20Stats()
+{
+    return stats;
+}
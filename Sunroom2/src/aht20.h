@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * AHT20 temperature/humidity sensor on the default Wire bus, run by a job so the loop never
+ * waits on a conversion: the job triggers a measurement, comes back when it should be done
+ * and collects it. The sensor is set up once and only reset again after a few reads in a row
+ * fail, with the retries backing off while it stays missing.
+ */
+
+/**
+ * Gets every finished reading on the loop task. ok is false once the sensor is considered
+ * lost, temperature and humidity are meaningless then.
+ */
+typedef void (*Aht20ReadingCallback)(bool ok, float temperature, float humidity);
+
+struct Aht20Stats
+{
+    uint32_t reads;
+    uint32_t failures;
+    uint32_t consecutiveFailures;
+    uint32_t resets;
+    /**
+     * From triggering a measurement to having its result, in us
+     */
+    uint32_t lastLatencyUs;
+    uint32_t maxLatencyUs;
+    /**
+     * Longest a single I2C transfer held up the loop, in us
+     */
+    uint32_t maxBusUs;
+};
+
+/**
+ * Start reading the sensor every intervalMs
+ */
+void aht20Setup(unsigned long intervalMs, Aht20ReadingCallback callback);
+
+/**
+ * Safe to call from any task, the counters can be a read apart
+ */
+Aht20Stats getAht20Stats();
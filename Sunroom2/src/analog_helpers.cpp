@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include "definitions.h"
+#include "adc_sampler.h"
 
 /**
  * Reads the ADC on the given pin and returns the voltage
@@ -7,20 +8,30 @@
  */
 float readADC(int pin)
 {
-  int sum = 0;
-  for (int i = 0; i < 10; i++)
+  float average;
+  AdcReading reading;
+  if (getAdcReading(pin, reading))
   {
-    sum += analogRead(pin);
+    // the sampler already oversamples and filters this pin in the background
+    average = reading.value;
   }
-  float v = sum / 10.0;
-  v = (v / 4095) * 3.3;
+  else
+  {
+    int sum = 0;
+    for (int i = 0; i < 10; i++)
+    {
+      sum += analogRead(pin);
+    }
+    average = sum / 10.0;
+  }
+  float v = (average / 4095) * 3.3;
 
   // corrections
-  if (sum == (4095 * 10))
+  if (average >= 4095)
   {
     return 99;
   }
-  else if (sum == 0)
+  else if (average <= 0)
   {
     return -1.0;
   }
@@ -3,6 +3,7 @@
 /**
  * Reads the ADC on the given pin and returns the voltage
  * Includes corrections for the ADC for some given devices
+ * Uses the background sampler's filtered value when it samples the pin, only call from the loop task then
  */
 float readADC(int pin);
 
@@ -14,6 +14,8 @@ uint64_t DEVICE_3 = 0xe0286c12cfa4;
 
 String SSID = "";
 String PASSWORD = "";
+String TIMEZONE = "";
+TimezoneSource TIMEZONE_SOURCE = TIMEZONE_DEFAULT;
 
 int RESET_COUNTER = 0;
 
@@ -21,6 +23,7 @@ float CURRENT_TEMPERATURE = -100;
 float CURRENT_HUMIDITY = -1;
 float INTERNAL_CHIP_TEMPERATURE = -100;
 float CURRENT_PROBE_TEMPERATURE = -100;
+float PROBE_TEMPERATURES[MAX_PROBES] = {-100, -100, -100, -100};
 
 bool IS_HEAT_MAT_ON = false;
 bool IS_FAN_ON = false;
@@ -40,6 +43,5 @@ int IS_SWITCH_ON = 0;
 
 uint32_t FREE_HEAP = 0;
 
-RelayValue RELAY_VALUES[RELAY_COUNT] = {FORCE_OFF_AUTO_X};
 String RELAY_RULES[RELAY_COUNT] = {};
 String RELAY_LABELS[RELAY_COUNT] = {};
@@ -37,7 +37,7 @@ constexpr int RELAY_PINS[RELAY_COUNT] = {4, 5, 6, 7, 16, 17, 18, 8};
 constexpr int RELAY_PINS[RELAY_COUNT] = {15, 2, 4, 16, 17, 5, 18, 19};
 #endif
 
-// Pin values
+// Pin values, the relays themselves are packed in relay_state
 enum RelayValue
 {
     FORCE_OFF_AUTO_OFF = 00,
@@ -53,7 +53,6 @@ enum RelayValue
      */
     FORCE_X_AUTO_X = 22,
 };
-extern RelayValue RELAY_VALUES[RELAY_COUNT];
 
 // array of rule string pointers
 extern String RELAY_RULES[RELAY_COUNT];
@@ -72,6 +71,27 @@ extern uint64_t DEVICE_3;
 extern String SSID;
 extern String PASSWORD;
 
+enum TimezoneSource : uint8_t
+{
+    /**
+     * Nothing set yet, the clock is in UTC until discovery finds the timezone
+     */
+    TIMEZONE_DEFAULT = 0,
+    TIMEZONE_DISCOVERED = 1,
+    /**
+     * Set through /timezone, discovery leaves it alone
+     */
+    TIMEZONE_CONFIGURED = 2,
+};
+
+/**
+ * POSIX TZ string, e.g. "EST5EDT,M3.2.0,M11.1.0", the C library works out daylight saving from it.
+ * Empty for TIMEZONE_DEFAULT. Replaced under the device_commands text lock, use readTimezone
+ * outside the control loop.
+ */
+extern String TIMEZONE;
+extern TimezoneSource TIMEZONE_SOURCE;
+
 constexpr float NULL_TEMPERATURE = -100;
 
 extern float CURRENT_TEMPERATURE;
@@ -79,6 +99,12 @@ extern float CURRENT_HUMIDITY;
 extern float INTERNAL_CHIP_TEMPERATURE;
 extern float CURRENT_PROBE_TEMPERATURE;
 
+constexpr int MAX_PROBES = 4;
+/**
+ * Every DS18B20 probe's temperature, CURRENT_PROBE_TEMPERATURE is the first one
+ */
+extern float PROBE_TEMPERATURES[MAX_PROBES];
+
 extern bool IS_HEAT_MAT_ON;
 extern bool IS_FAN_ON;
 extern float LED_LEVEL;
@@ -0,0 +1,260 @@
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "device_commands.h"
+#include "rule_helpers.h"
+#include "preferences_helpers.h"
+#include "logger.h"
+#include "job_scheduler.h"
+#include "relay_state.h"
+#include "time_helpers.h"
+
+constexpr int DEVICE_COMMAND_QUEUE_LENGTH = 16;
+
+static QueueHandle_t deviceCommandQueue = nullptr;
+
+/**
+ * Guards the RELAY_RULES, RELAY_LABELS and TIMEZONE strings, the control loop holds it while
+ * it replaces one and readers while they copy one. Everything else in the device state goes
+ * through the lock free snapshot in device_state.
+ */
+static SemaphoreHandle_t textMutex = nullptr;
+
+/**
+ * Held from taking a command id to queuing the command, so ids reach the queue in order
+ * no matter which task sends them
+ */
+static SemaphoreHandle_t sendMutex = nullptr;
+
+static std::atomic<uint32_t> nextCommandId{1};
+static std::atomic<uint32_t> lastAppliedCommandId{0};
+
+void deviceCommandsSetup()
+{
+    deviceCommandQueue = xQueueCreate(DEVICE_COMMAND_QUEUE_LENGTH, sizeof(DeviceCommand));
+    textMutex = xSemaphoreCreateMutex();
+    sendMutex = xSemaphoreCreateMutex();
+}
+
+static void lockText()
+{
+    if (textMutex != nullptr)
+    {
+        xSemaphoreTake(textMutex, portMAX_DELAY);
+    }
+}
+
+static void unlockText()
+{
+    if (textMutex != nullptr)
+    {
+        xSemaphoreGive(textMutex);
+    }
+}
+
+static void freeCommand(DeviceCommand &command)
+{
+    delete command.rule;
+    delete command.text;
+    command.rule = nullptr;
+    command.text = nullptr;
+}
+
+/**
+ * Queue all of commands or, if the queue hasn't room for all of them, none. Returns the id of
+ * the last one or 0.
+ */
+static uint32_t sendCommands(DeviceCommand *commands, int count)
+{
+    if (deviceCommandQueue == nullptr)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            freeCommand(commands[i]);
+        }
+        return 0;
+    }
+    // the web server and the timezone lookup both send, an id taken before another task's
+    // mustn't reach the queue after it or CommandsApplied would pass a command still queued.
+    // Only senders take from the queue's space, so once there is room it stays until the give.
+    xSemaphoreTake(sendMutex, portMAX_DELAY);
+    bool queued = uxQueueSpacesAvailable(deviceCommandQueue) >= static_cast<UBaseType_t>(count);
+    for (int i = 0; queued && i < count; i++)
+    {
+        commands[i].id = nextCommandId.fetch_add(1);
+        xQueueSend(deviceCommandQueue, &commands[i], 0);
+    }
+    xSemaphoreGive(sendMutex);
+    if (!queued)
+    {
+        LOG_WARN("Command queue full, dropped %d commands", count);
+        for (int i = 0; i < count; i++)
+        {
+            freeCommand(commands[i]);
+        }
+        return 0;
+    }
+    wakeJobScheduler();
+    return count > 0 ? commands[count - 1].id : 0;
+}
+
+static uint32_t sendCommand(DeviceCommand &command)
+{
+    return sendCommands(&command, 1);
+}
+
+uint32_t sendSetRelayForces(uint32_t relays, const RelayValue values[RELAY_COUNT])
+{
+    DeviceCommand commands[RELAY_COUNT];
+    int count = 0;
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        if ((relays >> i) & 1)
+        {
+            commands[count++] = {0, COMMAND_SET_RELAY_FORCE, static_cast<uint8_t>(i), values[i], nullptr, nullptr};
+        }
+    }
+    return sendCommands(commands, count);
+}
+
+uint32_t sendSetRule(int relay, CompiledRule &&rule)
+{
+    DeviceCommand command = {0, COMMAND_SET_RULE, static_cast<uint8_t>(relay), FORCE_X_AUTO_X, new CompiledRule(std::move(rule)), nullptr};
+    return sendCommand(command);
+}
+
+uint32_t sendSetLabel(int relay, const String &label)
+{
+    DeviceCommand command = {0, COMMAND_SET_LABEL, static_cast<uint8_t>(relay), FORCE_X_AUTO_X, nullptr, new String(label)};
+    return sendCommand(command);
+}
+
+uint32_t sendSetTimezone(const String &timezone, bool discovered)
+{
+    DeviceCommandType type = discovered ? COMMAND_SET_DISCOVERED_TIMEZONE : COMMAND_SET_TIMEZONE;
+    DeviceCommand command = {0, type, 0, FORCE_X_AUTO_X, nullptr, new String(timezone)};
+    return sendCommand(command);
+}
+
+/**
+ * Replace TIMEZONE and start using it, returns false if a configured one keeps it from changing
+ */
+static bool applyTimezoneCommand(const DeviceCommand &command)
+{
+    TimezoneSource source = TIMEZONE_CONFIGURED;
+    if (command.type == COMMAND_SET_DISCOVERED_TIMEZONE)
+    {
+        if (TIMEZONE_SOURCE == TIMEZONE_CONFIGURED)
+        {
+            return false;
+        }
+        source = TIMEZONE_DISCOVERED;
+    }
+    else if (command.text->isEmpty())
+    {
+        source = TIMEZONE_DEFAULT;
+    }
+    lockText();
+    TIMEZONE = *command.text;
+    TIMEZONE_SOURCE = source;
+    unlockText();
+    applyTimezone();
+    return true;
+}
+
+void processDeviceCommands()
+{
+    if (deviceCommandQueue == nullptr)
+    {
+        return;
+    }
+
+    bool valuesChanged = false;
+    bool rulesChanged = false;
+    bool labelsChanged = false;
+    bool timezoneChanged = false;
+    DeviceCommand command;
+    while (xQueueReceive(deviceCommandQueue, &command, 0) == pdTRUE)
+    {
+        if (command.relay < RELAY_COUNT)
+        {
+            switch (command.type)
+            {
+            case COMMAND_SET_RELAY_FORCE:
+                setRelayValue(command.relay, command.value);
+                markRelayRuleDirty(command.relay);
+                valuesChanged = true;
+                break;
+            case COMMAND_SET_RULE:
+                lockText();
+                installRelayRule(command.relay, std::move(*command.rule));
+                unlockText();
+                rulesChanged = true;
+                break;
+            case COMMAND_SET_LABEL:
+                lockText();
+                RELAY_LABELS[command.relay] = *command.text;
+                unlockText();
+                labelsChanged = true;
+                break;
+            case COMMAND_SET_TIMEZONE:
+            case COMMAND_SET_DISCOVERED_TIMEZONE:
+                timezoneChanged |= applyTimezoneCommand(command);
+                break;
+            }
+        }
+        freeCommand(command);
+        lastAppliedCommandId.store(command.id);
+    }
+
+    // one write per kind no matter how many commands were queued
+    if (valuesChanged)
+    {
+        writeRelayValues();
+    }
+    if (rulesChanged)
+    {
+        writeRelayRules();
+    }
+    if (labelsChanged)
+    {
+        writeRelayLabels();
+    }
+    if (timezoneChanged)
+    {
+        writeTimezone();
+    }
+}
+
+uint32_t lastAppliedDeviceCommand()
+{
+    return lastAppliedCommandId.load();
+}
+
+String readRelayRule(int index, RuleOptimization &optimization)
+{
+    lockText();
+    String rule = RELAY_RULES[index];
+    optimization = getRelayRuleOptimization(index);
+    unlockText();
+    return rule;
+}
+
+String readRelayLabel(int index)
+{
+    lockText();
+    String label = RELAY_LABELS[index];
+    unlockText();
+    return label;
+}
+
+String readTimezone(TimezoneSource &source)
+{
+    lockText();
+    String timezone = TIMEZONE;
+    source = TIMEZONE_SOURCE;
+    unlockText();
+    return timezone;
+}
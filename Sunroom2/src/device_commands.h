@@ -0,0 +1,76 @@
+#pragma once
+#include <Arduino.h>
+#include "definitions.h"
+#include "rule_compiler.h"
+
+/**
+ * Changes the web server asks the control loop to make. The handlers only queue these and
+ * return, the control loop applies them in order and persists the result.
+ */
+enum DeviceCommandType : uint8_t
+{
+    /**
+     * Set a relay's value, its rule then runs and rewrites the auto digit
+     */
+    COMMAND_SET_RELAY_FORCE = 0,
+    COMMAND_SET_RULE = 1,
+    COMMAND_SET_LABEL = 2,
+    /**
+     * A timezone from /timezone, an empty one goes back to discovering it
+     */
+    COMMAND_SET_TIMEZONE = 3,
+    /**
+     * A timezone the background discovery found, ignored if one was set through /timezone
+     */
+    COMMAND_SET_DISCOVERED_TIMEZONE = 4,
+};
+
+struct DeviceCommand
+{
+    uint32_t id;
+    DeviceCommandType type;
+    uint8_t relay;
+    RelayValue value;
+    /**
+     * Payloads for COMMAND_SET_RULE, and the label or timezone of the others, owned by the
+     * command and deleted once it is applied
+     */
+    CompiledRule *rule;
+    String *text;
+};
+
+void deviceCommandsSetup();
+
+/**
+ * Queue a command, safe to call from any task. Each returns the command's id (ids only
+ * increase), or 0 if the queue is full. The command has been applied once the published
+ * DeviceState's commandsApplied reaches the id.
+ *
+ * sendSetRelayForces sets every relay whose bit is set in relays to its entry in values, and
+ * queues all of them or, returning 0, none.
+ */
+uint32_t sendSetRelayForces(uint32_t relays, const RelayValue values[RELAY_COUNT]);
+uint32_t sendSetRule(int relay, CompiledRule &&rule);
+uint32_t sendSetLabel(int relay, const String &label);
+uint32_t sendSetTimezone(const String &timezone, bool discovered);
+
+/**
+ * Apply every queued command and persist what changed, only call from the control loop
+ */
+void processDeviceCommands();
+
+/**
+ * Id of the last command the control loop applied, read by publishDeviceState
+ */
+uint32_t lastAppliedDeviceCommand();
+
+/**
+ * Copies of a relay's rule and label, safe to call from any task
+ */
+String readRelayRule(int index, RuleOptimization &optimization);
+String readRelayLabel(int index);
+
+/**
+ * Copy of TIMEZONE and its source, safe to call from any task
+ */
+String readTimezone(TimezoneSource &source);
@@ -0,0 +1,99 @@
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "device_state.h"
+#include "rule_helpers.h"
+#include "device_commands.h"
+#include "relay_state.h"
+
+static_assert(std::is_trivially_copyable<DeviceState>::value, "DeviceState is copied word by word");
+static_assert(sizeof(DeviceState) % sizeof(uint32_t) == 0, "DeviceState is copied word by word");
+
+constexpr size_t STATE_WORDS = sizeof(DeviceState) / sizeof(uint32_t);
+
+/**
+ * Seqlock around the published state. The sequence is odd while the control loop is
+ * copying in a new state, readers retry if it was odd or moved while they were copying.
+ * The words are atomics so a reader racing the writer sees stale or new words, never a torn one.
+ */
+static std::atomic<uint32_t> STATE_SEQUENCE{0};
+static std::atomic<uint32_t> STATE_WORDS_SHARED[STATE_WORDS];
+
+/**
+ * Last state published, only touched by the control loop
+ */
+static DeviceState PUBLISHED_STATE = {};
+
+/**
+ * After this many failed reads the reader sleeps a tick, the writer may be a lower priority
+ * task on the same core and can't finish while we spin
+ */
+constexpr int STATE_READ_SPINS = 16;
+
+void publishDeviceState()
+{
+    DeviceState state = {};
+    state.version = PUBLISHED_STATE.version;
+    state.temperature = CURRENT_TEMPERATURE;
+    state.humidity = CURRENT_HUMIDITY;
+    state.probeTemperature = CURRENT_PROBE_TEMPERATURE;
+    state.internalTemperature = INTERNAL_CHIP_TEMPERATURE;
+    state.lightLevel = LIGHT_LEVEL;
+    state.switchOn = IS_SWITCH_ON;
+    state.freeHeap = FREE_HEAP;
+    state.ruleEvaluations = RULE_EVALUATIONS;
+    state.ruleEvaluationsSkipped = RULE_EVALUATIONS_SKIPPED;
+    state.commandsApplied = lastAppliedDeviceCommand();
+    state.relays = readRelayState();
+
+    if (STATE_SEQUENCE.load(std::memory_order_relaxed) != 0 && memcmp(&state, &PUBLISHED_STATE, sizeof(state)) == 0)
+    {
+        return;
+    }
+    state.version++;
+    PUBLISHED_STATE = state;
+
+    uint32_t words[STATE_WORDS];
+    memcpy(words, &state, sizeof(state));
+
+    uint32_t sequence = STATE_SEQUENCE.load(std::memory_order_relaxed);
+    STATE_SEQUENCE.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < STATE_WORDS; i++)
+    {
+        STATE_WORDS_SHARED[i].store(words[i], std::memory_order_relaxed);
+    }
+    STATE_SEQUENCE.store(sequence + 2, std::memory_order_release);
+}
+
+DeviceState readDeviceState()
+{
+    uint32_t words[STATE_WORDS];
+    for (int attempt = 1;; attempt++)
+    {
+        uint32_t before = STATE_SEQUENCE.load(std::memory_order_acquire);
+        if ((before & 1) == 0)
+        {
+            for (size_t i = 0; i < STATE_WORDS; i++)
+            {
+                words[i] = STATE_WORDS_SHARED[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (STATE_SEQUENCE.load(std::memory_order_relaxed) == before)
+            {
+                break;
+            }
+        }
+        if (attempt % STATE_READ_SPINS == 0)
+        {
+            vTaskDelay(1);
+        }
+    }
+
+    DeviceState state;
+    memcpy(&state, words, sizeof(state));
+    return state;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <Arduino.h>
+#include "definitions.h"
+
+/**
+ * Copy of the device state for readers outside the control loop (the web server).
+ * The control loop owns the globals in definitions.cpp and publishes this after every pass,
+ * readers always get a consistent copy without taking a lock.
+ */
+struct DeviceState
+{
+    /**
+     * Bumped every time a changed state is published
+     */
+    uint32_t version;
+    float temperature;
+    float humidity;
+    float probeTemperature;
+    float internalTemperature;
+    int lightLevel;
+    int switchOn;
+    uint32_t freeHeap;
+    uint32_t ruleEvaluations;
+    uint32_t ruleEvaluationsSkipped;
+    /**
+     * Id of the last command from device_commands that has been applied and run through the rules
+     */
+    uint32_t commandsApplied;
+    /**
+     * The packed word from relay_state
+     */
+    uint32_t relays;
+};
+
+/**
+ * Copy the globals into the shared snapshot, only call from the control loop.
+ * Does nothing if nothing changed since the last publish.
+ */
+void publishDeviceState();
+
+/**
+ * Latest published state, safe to call from any task
+ */
+DeviceState readDeviceState();
@@ -0,0 +1,155 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "digital_inputs.h"
+#include "job_scheduler.h"
+#include "logger.h"
+
+constexpr int DIGITAL_INPUT_QUEUE_LENGTH = 16;
+
+struct DigitalInput
+{
+    uint8_t pin;
+    uint32_t debounceUs;
+    DigitalInputCallback callback;
+    esp_timer_handle_t timer;
+    /**
+     * Only the timer callback changes this once the input is set up
+     */
+    volatile uint8_t level;
+    volatile uint32_t edgeUs;
+    DigitalInputStats stats;
+};
+
+struct QueuedEdge
+{
+    uint8_t input;
+    DigitalInputEvent event;
+};
+
+static DigitalInput INPUTS[MAX_DIGITAL_INPUTS];
+static int inputCount = 0;
+static QueueHandle_t edgeQueue = nullptr;
+
+static void IRAM_ATTR onInputInterrupt(void *arg)
+{
+    DigitalInput &input = INPUTS[reinterpret_cast<uintptr_t>(arg)];
+    // a level interrupt keeps firing while the pin stays changed, the window's end re-arms it
+    gpio_intr_disable(static_cast<gpio_num_t>(input.pin));
+    input.edgeUs = micros();
+    input.stats.interrupts++;
+    // only takes the timer list's spinlock, so this is fine from an interrupt
+    esp_timer_start_once(input.timer, input.debounceUs);
+}
+
+/**
+ * Wait for the pin to leave level, the _WE modes are the ones that can wake from light sleep
+ */
+static void armInput(int index, uint8_t level)
+{
+    attachInterruptArg(INPUTS[index].pin, onInputInterrupt, reinterpret_cast<void *>(static_cast<uintptr_t>(index)),
+                       level == HIGH ? ONLOW_WE : ONHIGH_WE);
+}
+
+/**
+ * Runs on the esp_timer task when a debounce window ends
+ */
+static void onDebounceEnd(void *arg)
+{
+    int index = reinterpret_cast<uintptr_t>(arg);
+    DigitalInput &input = INPUTS[index];
+    uint8_t level = digitalRead(input.pin);
+    if (level == input.level)
+    {
+        input.stats.glitches++;
+        armInput(index, level);
+        return;
+    }
+
+    input.level = level;
+    input.stats.edges++;
+    QueuedEdge edge = {static_cast<uint8_t>(index), {input.pin, level, input.edgeUs, static_cast<uint32_t>(micros())}};
+    if (xQueueSend(edgeQueue, &edge, 0) == pdTRUE)
+    {
+        wakeJobScheduler();
+    }
+    else
+    {
+        input.stats.dropped++;
+    }
+    armInput(index, level);
+}
+
+int addDigitalInput(uint8_t pin, uint8_t mode, uint32_t debounceMs, DigitalInputCallback callback)
+{
+    if (inputCount >= MAX_DIGITAL_INPUTS)
+    {
+        return -1;
+    }
+    if (edgeQueue == nullptr)
+    {
+        edgeQueue = xQueueCreate(DIGITAL_INPUT_QUEUE_LENGTH, sizeof(QueuedEdge));
+    }
+
+    int index = inputCount;
+    DigitalInput &input = INPUTS[index];
+    input = {};
+    input.pin = pin;
+    input.debounceUs = debounceMs * 1000;
+    input.callback = callback;
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onDebounceEnd;
+    timerArgs.arg = reinterpret_cast<void *>(static_cast<uintptr_t>(index));
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "debounce";
+    if (esp_timer_create(&timerArgs, &input.timer) != ESP_OK)
+    {
+        LOG_ERROR("No debounce timer for pin %u", pin);
+        return -1;
+    }
+    inputCount++;
+
+    pinMode(pin, mode);
+    input.level = digitalRead(pin);
+    armInput(index, input.level);
+    return index;
+}
+
+int readDigitalInput(int input)
+{
+    return INPUTS[input].level;
+}
+
+void processDigitalInputs()
+{
+    if (edgeQueue == nullptr)
+    {
+        return;
+    }
+    QueuedEdge edge;
+    while (xQueueReceive(edgeQueue, &edge, 0) == pdTRUE)
+    {
+        DigitalInput &input = INPUTS[edge.input];
+        input.callback(edge.event);
+        uint32_t latency = micros() - edge.event.edgeUs;
+        input.stats.lastLatencyUs = latency;
+        input.stats.maxLatencyUs = max(input.stats.maxLatencyUs, latency);
+    }
+}
+
+int getDigitalInputCount()
+{
+    return inputCount;
+}
+
+uint8_t getDigitalInputPin(int input)
+{
+    return INPUTS[input].pin;
+}
+
+DigitalInputStats getDigitalInputStats(int input)
+{
+    return INPUTS[input].stats;
+}
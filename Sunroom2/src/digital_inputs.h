@@ -0,0 +1,78 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Debounced digital inputs that don't need polling. Each input waits on a level interrupt for
+ * its pin to leave the level it settled at, which also wakes the chip from light sleep. The
+ * interrupt turns itself off and starts a one shot timer for the debounce window, bounces
+ * inside the window are ignored. When the window ends the pin is read again: a changed level
+ * is queued as an edge for the loop, the same level was a glitch. Either way the interrupt
+ * is armed again for the level the pin is at.
+ */
+
+constexpr int MAX_DIGITAL_INPUTS = 8;
+
+struct DigitalInputEvent
+{
+    uint8_t pin;
+    /**
+     * Level the pin settled at
+     */
+    uint8_t level;
+    /**
+     * micros() of the first edge, and of the end of the debounce window that accepted it
+     */
+    uint32_t edgeUs;
+    uint32_t settledUs;
+};
+
+/**
+ * Gets every edge on the loop task, in the order they happened
+ */
+typedef void (*DigitalInputCallback)(const DigitalInputEvent &event);
+
+struct DigitalInputStats
+{
+    /**
+     * Interrupts, each starts a debounce window
+     */
+    uint32_t interrupts;
+    uint32_t edges;
+    /**
+     * Windows that ended with the pin back at its old level
+     */
+    uint32_t glitches;
+    /**
+     * Edges lost because the queue to the loop was full
+     */
+    uint32_t dropped;
+    /**
+     * From the first edge to the callback running on the loop task, in us
+     */
+    uint32_t lastLatencyUs;
+    uint32_t maxLatencyUs;
+};
+
+/**
+ * Watch pin (pinMode mode) with a debounce window of debounceMs. Returns the input's id,
+ * or -1 once MAX_DIGITAL_INPUTS have been added. Only call from the loop task.
+ */
+int addDigitalInput(uint8_t pin, uint8_t mode, uint32_t debounceMs, DigitalInputCallback callback);
+
+/**
+ * The level the input last settled at
+ */
+int readDigitalInput(int input);
+
+/**
+ * Hand every queued edge to its callback, only call from the loop task
+ */
+void processDigitalInputs();
+
+int getDigitalInputCount();
+uint8_t getDigitalInputPin(int input);
+
+/**
+ * Safe to call from any task, the counters can be an edge apart
+ */
+DigitalInputStats getDigitalInputStats(int input);
@@ -1,4 +1,55 @@
 #pragma once
+#include <Arduino.h>
 
-void temperatureProbeSetup(void);
-void temperatureProbeLoop(void);
+/**
+ * DS18B20 probes on one OneWire bus, run by a job so the loop never waits on a conversion:
+ * the job starts a conversion on every probe at once, comes back when it should be done and
+ * reads each probe by the address it was found at. The bus is only searched at setup and
+ * again when a probe stops answering.
+ */
+
+constexpr int DS18B20_MAX_PROBES = 4;
+
+/**
+ * Gets every finished reading on the loop task, probe is the index the probe was first found
+ * at and doesn't change when another one is lost. ok is false once the probe is considered
+ * lost, temperature is meaningless then.
+ */
+typedef void (*Ds18b20ReadingCallback)(int probe, bool ok, float temperature);
+
+struct Ds18b20ProbeStats
+{
+    uint32_t reads;
+    uint32_t failures;
+    uint32_t consecutiveFailures;
+};
+
+struct Ds18b20Stats
+{
+    uint32_t probes;
+    uint32_t conversions;
+    /**
+     * Searches of the bus, one at setup and one per lost probe after that
+     */
+    uint32_t discoveries;
+    /**
+     * From starting a conversion to having read every probe, in us
+     */
+    uint32_t lastLatencyUs;
+    uint32_t maxLatencyUs;
+    /**
+     * Longest a single bus transaction held up the loop, in us
+     */
+    uint32_t maxBusUs;
+    Ds18b20ProbeStats probe[DS18B20_MAX_PROBES];
+};
+
+/**
+ * Start reading every probe on pin every intervalMs
+ */
+void ds18b20Setup(uint8_t pin, unsigned long intervalMs, Ds18b20ReadingCallback callback);
+
+/**
+ * Safe to call from any task, the counters can be a read apart
+ */
+Ds18b20Stats getDs18b20Stats();
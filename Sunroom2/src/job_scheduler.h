@@ -0,0 +1,106 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Timed work for the loop task. Modules register periodic and one shot jobs in their setup,
+ * loop() then sleeps until the earliest job is due or something calls wakeJobScheduler().
+ *
+ * Jobs sit in a hashed timer wheel of JOB_WHEEL_SLOTS one millisecond slots, a job due at
+ * millisecond t is in slot t % JOB_WHEEL_SLOTS. Running the scheduler only walks the slots
+ * for the milliseconds that passed, and finding the next deadline walks forward from now.
+ *
+ * Everything except the wake functions and the stats getters must be called from the loop task.
+ */
+
+typedef void (*JobCallback)();
+
+constexpr int MAX_JOBS = 16;
+constexpr int NO_JOB = -1;
+
+struct JobStats
+{
+    uint32_t runs;
+    /**
+     * Periods a periodic job missed because it started a whole interval or more late
+     */
+    uint32_t overruns;
+    /**
+     * How late the job started compared to its deadline, in ms
+     */
+    uint32_t lastLateMs;
+    uint32_t maxLateMs;
+    uint32_t totalLateMs;
+    /**
+     * How long the callback took, in us
+     */
+    uint32_t lastRunUs;
+    uint32_t maxRunUs;
+};
+
+struct JobSchedulerStats
+{
+    /**
+     * Times runJobScheduler waited for a job or a wake, and how many of those waits
+     * wakeJobScheduler cut short
+     */
+    uint32_t sleeps;
+    uint32_t eventWakes;
+    /**
+     * Time spent waiting in runJobScheduler and everything else since the first run, in ms.
+     * With power management on, the waiting is when the chip can clock down and light sleep.
+     */
+    uint32_t asleepMs;
+    uint32_t awakeMs;
+    /**
+     * From a wakeJobScheduler call to the loop running again, in us
+     */
+    uint32_t lastWakeLatencyUs;
+    uint32_t maxWakeLatencyUs;
+};
+
+/**
+ * Run callback every intervalMs, the first time after firstDelayMs.
+ * Returns the job's id, or NO_JOB if MAX_JOBS are already registered.
+ */
+int addPeriodicJob(const char *name, unsigned long intervalMs, JobCallback callback, unsigned long firstDelayMs = 0);
+
+/**
+ * Run callback once after delayMs. The job stays registered so scheduleJob can run it again.
+ */
+int addOneShotJob(const char *name, JobCallback callback, unsigned long delayMs);
+
+/**
+ * Move a job's next run to delayMs from now, this also re-arms a one shot job that already ran
+ */
+void scheduleJob(int job, unsigned long delayMs);
+
+/**
+ * Sleep until the next job is due (at most maxSleepMs) or wakeJobScheduler is called,
+ * then run every job that is due, earliest deadline first
+ */
+void runJobScheduler(unsigned long maxSleepMs = 60 * 1000);
+
+/**
+ * Cut the current sleep short, e.g. because an event was queued. Safe to call from any task.
+ */
+void wakeJobScheduler();
+
+/**
+ * wakeJobScheduler for interrupt handlers
+ */
+void wakeJobSchedulerFromISR();
+
+int getJobCount();
+const char *getJobName(int job);
+unsigned long getJobInterval(int job);
+
+/**
+ * Each counter is a single word so this can be read from any task, the counters of
+ * one job can be a run apart from each other
+ */
+JobStats getJobStats(int job);
+
+/**
+ * Safe to call from any task, like getJobStats the counters can be a pass apart
+ */
+JobSchedulerStats getJobSchedulerStats();
@@ -2,3 +2,8 @@
 #include <map>
 
 String buildJson(std::map<String, String> data);
+
+/**
+ * Like buildJson but the values are already json (e.g. built with buildJson) so they aren't quoted
+ */
+String buildJsonOfJson(std::map<String, String> data);
@@ -0,0 +1,415 @@
+#include <Arduino.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "logger.h"
+
+/**
+ * Records waiting to be drained. Producers reserve space by moving ringHead with a CAS and
+ * mark the record committed when it is filled in, the drain task is the only consumer.
+ * Positions only ever increase, they are taken modulo the size when indexing.
+ *
+ * Record layout:
+ * u8 state, u8 argc, u16 size, u32 millis, LogFormat pointer, then per argument a
+ * LogArgType byte followed by the value (strings are a u8 length and the bytes)
+ */
+constexpr uint32_t LOG_RING_SIZE = 4096;
+constexpr uint32_t LOG_MAX_RECORD_SIZE = 512;
+constexpr uint32_t LOG_HEADER_SIZE = 8 + sizeof(const LogFormat *);
+constexpr uint8_t LOG_RECORD_EMPTY = 0;
+constexpr uint8_t LOG_RECORD_COMMITTED = 1;
+
+/**
+ * Drained records are kept here for GET /logs, the oldest are dropped first
+ */
+constexpr uint32_t LOG_HISTORY_SIZE = 4096;
+
+constexpr uint32_t LOG_DRAIN_INTERVAL_MS = 20;
+
+#ifndef LOG_DRAIN_SERIAL
+#define LOG_DRAIN_SERIAL 1
+#endif
+
+static uint8_t RING[LOG_RING_SIZE] = {};
+static std::atomic<uint32_t> ringHead(0);
+static std::atomic<uint32_t> ringTail(0);
+
+static uint8_t HISTORY[LOG_HISTORY_SIZE];
+static uint32_t historyStart = 0;
+static uint32_t historyLength = 0;
+static SemaphoreHandle_t historyMutex = nullptr;
+
+uint32_t LOG_DROPPED = 0;
+
+static void ringWrite(uint32_t pos, const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        RING[(pos + i) % LOG_RING_SIZE] = bytes[i];
+    }
+}
+
+static void ringRead(uint32_t pos, void *data, size_t size)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        bytes[i] = RING[(pos + i) % LOG_RING_SIZE];
+    }
+}
+
+bool logReserve(LogRecordWriter &writer, const LogFormat *format, uint8_t argc, size_t argsSize)
+{
+    uint32_t size = LOG_HEADER_SIZE + argsSize;
+    uint32_t head = ringHead.load(std::memory_order_relaxed);
+    do
+    {
+        if (size > LOG_MAX_RECORD_SIZE || head + size - ringTail.load(std::memory_order_acquire) > LOG_RING_SIZE)
+        {
+            __atomic_fetch_add(&LOG_DROPPED, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!ringHead.compare_exchange_weak(head, head + size, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    // the state byte stays empty until logCommit
+    writer.start = head;
+    writer.pos = head + 1;
+    uint16_t size16 = size;
+    uint32_t timestamp = millis();
+    logPut(writer, &argc, 1);
+    logPut(writer, &size16, sizeof(size16));
+    logPut(writer, &timestamp, sizeof(timestamp));
+    logPut(writer, &format, sizeof(format));
+    return true;
+}
+
+void logPut(LogRecordWriter &writer, const void *data, size_t size)
+{
+    ringWrite(writer.pos, data, size);
+    writer.pos += size;
+}
+
+void logCommit(LogRecordWriter &writer)
+{
+    __atomic_store_n(&RING[writer.start % LOG_RING_SIZE], LOG_RECORD_COMMITTED, __ATOMIC_RELEASE);
+}
+
+void logPutArg(LogRecordWriter &writer, float value)
+{
+    uint8_t type = LOG_ARG_FLOAT;
+    logPut(writer, &type, 1);
+    logPut(writer, &value, sizeof(value));
+}
+
+void logPutArg(LogRecordWriter &writer, double value)
+{
+    uint8_t type = LOG_ARG_DOUBLE;
+    logPut(writer, &type, 1);
+    logPut(writer, &value, sizeof(value));
+}
+
+static void logPutString(LogRecordWriter &writer, const char *str, size_t length)
+{
+    uint8_t type = LOG_ARG_STRING;
+    uint8_t length8 = std::min(length, LOG_MAX_STRING_ARG);
+    logPut(writer, &type, 1);
+    logPut(writer, &length8, 1);
+    logPut(writer, str, length8);
+}
+
+void logPutArg(LogRecordWriter &writer, const char *str)
+{
+    logPutString(writer, str, strlen(str));
+}
+
+void logPutArg(LogRecordWriter &writer, const String &str)
+{
+    logPutString(writer, str.c_str(), str.length());
+}
+
+/**
+ * Size of one encoded argument, 0 if the type is unknown
+ */
+static size_t argSize(const uint8_t *arg)
+{
+    switch (arg[0])
+    {
+    case LOG_ARG_INT32:
+    case LOG_ARG_UINT32:
+    case LOG_ARG_FLOAT:
+        return 5;
+    case LOG_ARG_INT64:
+    case LOG_ARG_UINT64:
+    case LOG_ARG_DOUBLE:
+        return 9;
+    case LOG_ARG_STRING:
+        return 2 + arg[1];
+    default:
+        return 0;
+    }
+}
+
+static const char *fileName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash == nullptr ? path : slash + 1;
+}
+
+/**
+ * printf the format with the encoded arguments, one conversion at a time since
+ * the argument types are only known at runtime. log_decoder.py does the same.
+ */
+static void formatMessage(char *out, size_t outSize, const char *format, const uint8_t *args, const uint8_t *argsEnd)
+{
+    size_t len = 0;
+    const char *p = format;
+    while (*p && len + 1 < outSize)
+    {
+        if (*p != '%')
+        {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        const char *specStart = p++;
+        char spec[24] = "%";
+        size_t specLen = 1;
+        while (*p && strchr("-+ #0123456789.", *p) && specLen < sizeof(spec) - 4)
+        {
+            spec[specLen++] = *p++;
+        }
+        while (*p && strchr("hlLqjzt", *p))
+        {
+            p++;
+        }
+        char conversion = *p ? *p++ : 'd';
+
+        size_t size = args < argsEnd ? argSize(args) : 0;
+        if (size == 0 || args + size > argsEnd)
+        {
+            // missing argument, print the spec as it was written
+            size_t specSize = std::min<size_t>(p - specStart, outSize - 1 - len);
+            memcpy(out + len, specStart, specSize);
+            len += specSize;
+            continue;
+        }
+
+        int written = 0;
+        uint8_t type = args[0];
+        if (type == LOG_ARG_STRING)
+        {
+            char str[LOG_MAX_STRING_ARG + 1];
+            memcpy(str, args + 2, args[1]);
+            str[args[1]] = 0;
+            strcpy(spec + specLen, "s");
+            written = snprintf(out + len, outSize - len, spec, str);
+        }
+        else if (type == LOG_ARG_FLOAT || type == LOG_ARG_DOUBLE)
+        {
+            double value;
+            if (type == LOG_ARG_FLOAT)
+            {
+                float narrow;
+                memcpy(&narrow, args + 1, sizeof(narrow));
+                value = narrow;
+            }
+            else
+            {
+                memcpy(&value, args + 1, sizeof(value));
+            }
+            spec[specLen] = strchr("fFeEgGaA", conversion) ? conversion : 'g';
+            spec[specLen + 1] = 0;
+            written = snprintf(out + len, outSize - len, spec, value);
+        }
+        else
+        {
+            bool isSigned = type == LOG_ARG_INT32 || type == LOG_ARG_INT64;
+            long long value;
+            if (type == LOG_ARG_INT64 || type == LOG_ARG_UINT64)
+            {
+                memcpy(&value, args + 1, sizeof(value));
+            }
+            else
+            {
+                int32_t narrow;
+                memcpy(&narrow, args + 1, sizeof(narrow));
+                value = isSigned ? static_cast<long long>(narrow) : static_cast<long long>(static_cast<uint32_t>(narrow));
+            }
+            if (conversion == 'c')
+            {
+                strcpy(spec + specLen, "c");
+                written = snprintf(out + len, outSize - len, spec, static_cast<int>(value));
+            }
+            else
+            {
+                if (!strchr("diouxX", conversion))
+                {
+                    conversion = isSigned ? 'd' : 'u';
+                }
+                spec[specLen] = 'l';
+                spec[specLen + 1] = 'l';
+                spec[specLen + 2] = conversion;
+                spec[specLen + 3] = 0;
+                written = snprintf(out + len, outSize - len, spec, value);
+            }
+        }
+        args += size;
+        len = std::min(len + std::max(written, 0), outSize - 1);
+    }
+    out[len] = 0;
+}
+
+static void printRecord(const uint8_t *record)
+{
+    static const char LEVELS[] = "DIWE";
+    const LogFormat *format;
+    uint16_t size;
+    uint32_t timestamp;
+    memcpy(&size, record + 2, sizeof(size));
+    memcpy(&timestamp, record + 4, sizeof(timestamp));
+    memcpy(&format, record + 8, sizeof(format));
+
+    char line[384];
+    int prefix = snprintf(line, sizeof(line), "[%8lu][%c] %s:%u ", static_cast<unsigned long>(timestamp),
+                          LEVELS[format->level % 4], fileName(format->file), format->line);
+    formatMessage(line + prefix, sizeof(line) - prefix, format->format, record + LOG_HEADER_SIZE, record + size);
+    Serial.println(line);
+}
+
+static void historyAppend(const uint8_t *record, uint16_t size)
+{
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    while (historyLength + size > LOG_HISTORY_SIZE)
+    {
+        uint16_t oldest = HISTORY[(historyStart + 2) % LOG_HISTORY_SIZE] | (HISTORY[(historyStart + 3) % LOG_HISTORY_SIZE] << 8);
+        historyStart = (historyStart + oldest) % LOG_HISTORY_SIZE;
+        historyLength -= oldest;
+    }
+    for (uint16_t i = 0; i < size; i++)
+    {
+        HISTORY[(historyStart + historyLength + i) % LOG_HISTORY_SIZE] = record[i];
+    }
+    historyLength += size;
+    xSemaphoreGive(historyMutex);
+}
+
+/**
+ * Move every committed record out of the ring
+ */
+static void drainLogs()
+{
+    uint8_t record[LOG_MAX_RECORD_SIZE];
+    uint32_t tail = ringTail.load(std::memory_order_relaxed);
+    while (tail != ringHead.load(std::memory_order_acquire))
+    {
+        if (__atomic_load_n(&RING[tail % LOG_RING_SIZE], __ATOMIC_ACQUIRE) != LOG_RECORD_COMMITTED)
+        {
+            // still being written, records are drained in order
+            break;
+        }
+        uint16_t size;
+        ringRead(tail + 2, &size, sizeof(size));
+        ringRead(tail, record, size);
+
+        // reserved space has to read as empty until it is committed again
+        for (uint16_t i = 0; i < size; i++)
+        {
+            RING[(tail + i) % LOG_RING_SIZE] = LOG_RECORD_EMPTY;
+        }
+        tail += size;
+        ringTail.store(tail, std::memory_order_release);
+
+#if LOG_DRAIN_SERIAL
+        printRecord(record);
+#endif
+        historyAppend(record, size);
+    }
+}
+
+static void drainTask(void *)
+{
+    while (true)
+    {
+        drainLogs();
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+void loggerSetup()
+{
+    historyMutex = xSemaphoreCreateMutex();
+    xTaskCreate(drainTask, "logDrain", 4096, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+}
+
+static void writeBytes(Print &out, const void *data, size_t size)
+{
+    out.write(static_cast<const uint8_t *>(data), size);
+}
+
+void writeLogDump(Print &out)
+{
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    std::vector<uint8_t> records(historyLength);
+    for (uint32_t i = 0; i < historyLength; i++)
+    {
+        records[i] = HISTORY[(historyStart + i) % LOG_HISTORY_SIZE];
+    }
+    xSemaphoreGive(historyMutex);
+
+    // header: "SLOG", version, dropped records and the current millis, all little endian
+    uint8_t version = 1;
+    uint32_t now = millis();
+    writeBytes(out, "SLOG", 4);
+    writeBytes(out, &version, 1);
+    writeBytes(out, &LOG_DROPPED, sizeof(LOG_DROPPED));
+    writeBytes(out, &now, sizeof(now));
+
+    // each format is sent once ('F') the first time a record ('R') uses it
+    std::vector<const LogFormat *> formats;
+    for (size_t pos = 0; pos < records.size();)
+    {
+        const uint8_t *record = &records[pos];
+        const LogFormat *format;
+        uint16_t size;
+        memcpy(&size, record + 2, sizeof(size));
+        memcpy(&format, record + 8, sizeof(format));
+
+        uint16_t id = std::find(formats.begin(), formats.end(), format) - formats.begin();
+        if (id == formats.size())
+        {
+            formats.push_back(format);
+            const char *file = fileName(format->file);
+            uint8_t fileLength = std::min(strlen(file), LOG_MAX_STRING_ARG);
+            uint16_t formatLength = strlen(format->format);
+            writeBytes(out, "F", 1);
+            writeBytes(out, &id, sizeof(id));
+            writeBytes(out, &format->level, 1);
+            writeBytes(out, &format->line, sizeof(format->line));
+            writeBytes(out, &fileLength, 1);
+            writeBytes(out, file, fileLength);
+            writeBytes(out, &formatLength, sizeof(formatLength));
+            writeBytes(out, format->format, formatLength);
+        }
+
+        // R, format id, millis, argc, the arguments as they were encoded
+        writeBytes(out, "R", 1);
+        writeBytes(out, &id, sizeof(id));
+        writeBytes(out, record + 4, 4);
+        writeBytes(out, record + 1, 1);
+        uint16_t argsSize = size - LOG_HEADER_SIZE;
+        writeBytes(out, &argsSize, sizeof(argsSize));
+        writeBytes(out, record + LOG_HEADER_SIZE, argsSize);
+        pos += size;
+    }
+}
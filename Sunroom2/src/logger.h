@@ -0,0 +1,156 @@
+#pragma once
+#include <Arduino.h>
+#include <type_traits>
+
+/**
+ * Deferred binary logging.
+ *
+ * LOG_INFO("Temperature: %.2fC", CURRENT_TEMPERATURE) doesn't format anything, it copies a
+ * pointer to a static descriptor (the format string stays in flash) and the raw arguments
+ * into a lock-free ring buffer. A low priority task drains the ring, formats the lines for
+ * Serial and keeps the raw records for GET /logs, which log_decoder.py turns back into text.
+ *
+ * Levels below LOG_LEVEL are compiled out, set it with e.g. -DLOG_LEVEL=LOG_LEVEL_DEBUG.
+ * Supported conversions: %d %i %u %x %X %o %c with any integer or enum, %f %e %g with
+ * float/double and %s with const char * or String (strings are cut at 255 bytes).
+ */
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+
+#define LOG_AT(level, format, ...)                                           \
+    do                                                                       \
+    {                                                                        \
+        if (level >= LOG_LEVEL)                                              \
+        {                                                                    \
+            static const LogFormat logFormat = {level, __LINE__, __FILE__, format}; \
+            logWrite(&logFormat, ##__VA_ARGS__);                             \
+        }                                                                    \
+    } while (0)
+
+/**
+ * Where a log line came from, one static instance per LOG_* call site
+ */
+struct LogFormat
+{
+    uint8_t level;
+    uint16_t line;
+    const char *file;
+    const char *format;
+};
+
+enum LogArgType : uint8_t
+{
+    LOG_ARG_INT32 = 1,
+    LOG_ARG_UINT32 = 2,
+    LOG_ARG_INT64 = 3,
+    LOG_ARG_UINT64 = 4,
+    LOG_ARG_FLOAT = 5,
+    LOG_ARG_DOUBLE = 6,
+    LOG_ARG_STRING = 7,
+};
+
+constexpr size_t LOG_MAX_STRING_ARG = 255;
+
+/**
+ * A reserved slot in the ring buffer that is being filled in
+ */
+struct LogRecordWriter
+{
+    uint32_t start;
+    uint32_t pos;
+};
+
+bool logReserve(LogRecordWriter &writer, const LogFormat *format, uint8_t argc, size_t size);
+void logPut(LogRecordWriter &writer, const void *data, size_t size);
+void logCommit(LogRecordWriter &writer);
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, size_t>::type logArgSize(const T &)
+{
+    return 1 + (sizeof(T) > 4 ? 8 : 4);
+}
+inline size_t logArgSize(float) { return 1 + sizeof(float); }
+inline size_t logArgSize(double) { return 1 + sizeof(double); }
+inline size_t logArgSize(const char *str) { return 2 + std::min(strlen(str), LOG_MAX_STRING_ARG); }
+inline size_t logArgSize(const String &str) { return 2 + std::min<size_t>(str.length(), LOG_MAX_STRING_ARG); }
+
+/**
+ * Integer type an argument is stored as, enums are stored as their underlying type
+ */
+template <typename T, bool = std::is_enum<T>::value>
+struct LogIntType
+{
+    using type = T;
+};
+template <typename T>
+struct LogIntType<T, true>
+{
+    using type = typename std::underlying_type<T>::type;
+};
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type logPutArg(LogRecordWriter &writer, const T &value)
+{
+    bool isSigned = std::is_signed<typename LogIntType<T>::type>::value;
+    if (sizeof(T) > 4)
+    {
+        uint8_t type = isSigned ? LOG_ARG_INT64 : LOG_ARG_UINT64;
+        int64_t wide = static_cast<int64_t>(value);
+        logPut(writer, &type, 1);
+        logPut(writer, &wide, sizeof(wide));
+    }
+    else
+    {
+        uint8_t type = isSigned ? LOG_ARG_INT32 : LOG_ARG_UINT32;
+        int32_t narrow = static_cast<int32_t>(value);
+        logPut(writer, &type, 1);
+        logPut(writer, &narrow, sizeof(narrow));
+    }
+}
+void logPutArg(LogRecordWriter &writer, float value);
+void logPutArg(LogRecordWriter &writer, double value);
+void logPutArg(LogRecordWriter &writer, const char *str);
+void logPutArg(LogRecordWriter &writer, const String &str);
+
+/**
+ * Queue a record, never blocks. Records that don't fit are dropped and counted.
+ */
+template <typename... Args>
+void logWrite(const LogFormat *format, const Args &...args)
+{
+    LogRecordWriter writer;
+    if (!logReserve(writer, format, sizeof...(args), (logArgSize(args) + ... + 0)))
+    {
+        return;
+    }
+    (logPutArg(writer, args), ...);
+    logCommit(writer);
+}
+
+/**
+ * Records dropped because the ring buffer was full
+ */
+extern uint32_t LOG_DROPPED;
+
+/**
+ * Start the task that drains the ring buffer
+ */
+void loggerSetup();
+
+/**
+ * Write the recently drained records in the binary format log_decoder.py reads
+ */
+void writeLogDump(Print &out);
@@ -1,6 +1,6 @@
 #include <Arduino.h>
 #include "definitions.h"
-#include "ds18b20.h"
+#include "temperatureProbe.h"
 #include "temperatureMoisture.h"
 #include "device_identity.h"
 #include "servers.h"
@@ -8,6 +8,9 @@
 #include "preferences_helpers.h"
 #include "peripheral_controls.h"
 #include "time_helpers.h"
+#include "logger.h"
+#include "job_scheduler.h"
+#include "power_management.h"
 
 // Keep an eye on this: https://github.com/microsoft/devicescript
 
@@ -15,26 +18,29 @@
 
 void setup(void)
 {
+#ifndef SUNROOM_NATIVE
   // 10 secon delay to prevent boot loop from wrecking the flash memory
   delay(10000);
+#endif
   Serial.begin(BAUD);
+  loggerSetup();
+  powerManagementSetup();
   setupPreferences();
   checkDeviceIdentityOnSetup();
   wifiSetup();
-  // temperatureProbeSetup();
+  timeSetup();
+  temperatureMoistureSetup();
+  temperatureProbeSetup();
   peripheralControlsSetup();
   serverSetup();
   Serial.println("~~~ SETUP FINISHED ~~~");
 }
 
+/**
+ * Sleeps until the next job is due or an event wakes it, the jobs are registered by each module's setup
+ */
 void loop()
 {
-  wifiCheckInLoop();
-  updateTimeLoop();
-  temperatureMoistureLoop();
-  // temperatureProbeLoop();
+  runJobScheduler();
   controlPeripheralsLoop();
-  // delay(500);
-  // Serial.println("~~~ LOOP FINISHED ~~~");
-  delay(1);
 }
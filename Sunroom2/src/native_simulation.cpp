@@ -0,0 +1,68 @@
+#if defined(SUNROOM_NATIVE) && !defined(PIO_UNIT_TESTING)
+/**
+ * Entry point of the native build (pio run -e native), runs setup() and loop()
+ * as a Linux process against simulated sensors. Set SUNROOM_RUN_SECONDS to
+ * stop after that many seconds, e.g. when profiling. The tests bring their own main.
+ */
+#include <Arduino.h>
+#include <native_hal.h>
+#include "definitions.h"
+
+/**
+ * Sensor values follow the wall clock so rules see them change:
+ * temperature and humidity swing over 10 minutes, the photo sensor
+ * follows the time of day with 100Hz flicker and noise on top of it, and
+ * the light switch flips every 2 minutes.
+ */
+static void simulateSensors()
+{
+    float seconds = millis() / 1000.0;
+    float phase = 2 * M_PI * seconds / 600;
+    simSetAht20(22 + 4 * sin(phase), 55 + 10 * cos(phase));
+    simSetProbeTemperature(20 + 2 * sin(phase));
+
+    time_t now = time(nullptr);
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    bool isDay = timeinfo.tm_hour >= 7 && timeinfo.tm_hour < 19;
+    simSetAnalogInput(PHOTO_SENSOR_PIN, isDay ? 3000 : 200);
+
+    simSetDigitalInput(LIGHT_SWITCH_PIN, (millis() / 120000) % 2);
+}
+
+/**
+ * Print relay outputs with the time whenever one changes, relays are active low.
+ * The times show the stagger between relays and their minimum on and off times.
+ */
+static void reportRelays()
+{
+    static String last;
+    String relays;
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        relays += simGetDigitalOutput(RELAY_PINS[i]) == LOW ? '1' : '0';
+    }
+    if (relays != last)
+    {
+        Serial.println("[sim] " + String(millis()) + "ms relays " + relays);
+        last = relays;
+    }
+}
+
+int main()
+{
+    const char *runSeconds = getenv("SUNROOM_RUN_SECONDS");
+    unsigned long runMs = runSeconds != nullptr ? atol(runSeconds) * 1000 : 0;
+
+    simSetAnalogWaveform(PHOTO_SENSOR_PIN, 60, 10, 40);
+    simulateSensors();
+    setup();
+    while (runMs == 0 || millis() < runMs)
+    {
+        simulateSensors();
+        loop();
+        reportRelays();
+    }
+    return 0;
+}
+#endif
@@ -1,109 +1,137 @@
 #include <Arduino.h>
 #include <time.h>
 #include "definitions.h"
-#include "interval_timer.h"
+#include "job_scheduler.h"
 #include "time_helpers.h"
 #include <ArduinoJson.h>
 #include "rule_helpers.h"
+#include "sensor_events.h"
+#include "rule_scheduler.h"
+#include "logger.h"
+#include "device_state.h"
+#include "device_commands.h"
+#include "adc_sampler.h"
+#include "digital_inputs.h"
+#include "relay_outputs.h"
+#include "relay_state.h"
 
-static Timer timer(30000);
+// Rules normally run off sensor events, this sweep only catches anything an event missed
+constexpr unsigned long RULE_SWEEP_INTERVAL_MS = 5 * 60 * 1000;
+constexpr unsigned long PHOTO_SENSOR_INTERVAL_MS = 100;
+// Each value averages a whole burst (200 samples), then a median of 3 and a moving average
+constexpr AdcFilter PHOTO_SENSOR_FILTER = {200, 3, 0.5f};
+// Switch contacts bounce for a few ms, the switch's level only counts once it held this long
+constexpr uint32_t LIGHT_SWITCH_DEBOUNCE_MS = 5;
+
+// Only publish photo sensor changes bigger than this so adc noise doesn't flood the queue,
+// smaller drifts are picked up by the sweep
+constexpr int PHOTO_SENSOR_EVENT_THRESHOLD = 20;
+// Relays switch at least this far apart so their inrush currents don't add up
+constexpr uint32_t RELAY_STAGGER_MS = 100;
+// Once switched a relay stays that way this long, so a rule hovering around its threshold
+// doesn't wear out the contacts or short cycle whatever is plugged in
+constexpr RelayTiming RELAY_TIMING = {10 * 1000, 10 * 1000, true};
+// The lights follow the light switch right away, the stagger moves the other relays instead
+constexpr RelayTiming LIGHTS_RELAY_TIMING = {0, 0, false};
 int SUNROOM_LIGHTS_RELAY = 6;
 
 void turnOffRelay(int relay)
 {
-    int pin = RELAY_PINS[relay];
-    digitalWrite(pin, HIGH);
-    RELAY_VALUES[relay] = FORCE_OFF_AUTO_X;
+    setRelayOutput(relay, false);
+    setRelayValue(relay, FORCE_OFF_AUTO_X);
 }
 
 void turnOnRelay(int relay)
 {
-    int pin = RELAY_PINS[relay];
-    digitalWrite(pin, LOW);
-    RELAY_VALUES[relay] = FORCE_ON_AUTO_X;
+    setRelayOutput(relay, true);
+    setRelayValue(relay, FORCE_ON_AUTO_X);
 }
 
-void setupRelays()
-{
-    for (int i = 0; i < RELAY_COUNT; i++)
-    {
-        int pin = RELAY_PINS[i];
-        pinMode(pin, OUTPUT);
-        digitalWrite(pin, HIGH);
-    }
-}
-
-bool isRelayOn(RelayValue value)
+/**
+ * Only the relays whose value changed get written, all of them at once
+ */
+void relayRefresh()
 {
-    return value == FORCE_ON_AUTO_X || value == FORCE_ON_AUTO_ON || value == FORCE_ON_AUTO_OFF || value == FORCE_X_AUTO_ON;
+    setRelayOutputs(relayOnMask(readRelayState()));
+    applyRelayOutputs();
 }
 
-void relayRefresh()
+void onPhotoSensorReading(const AdcReading &reading)
 {
-    for (int i = 0; i < RELAY_COUNT; i++)
+    static int lastPublishedLevel = -1;
+    LIGHT_LEVEL = lround(reading.value);
+    if (abs(LIGHT_LEVEL - lastPublishedLevel) >= PHOTO_SENSOR_EVENT_THRESHOLD)
     {
-        digitalWrite(RELAY_PINS[i], !isRelayOn(RELAY_VALUES[i]));
+        lastPublishedLevel = LIGHT_LEVEL;
+        publishSensorEvent(SENSOR_PHOTO, LIGHT_LEVEL);
     }
 }
 
 void photoSensorSetup()
 {
-    // analog for PHOTO_SENSOR_PIN
     pinMode(PHOTO_SENSOR_PIN, INPUT);
+    adcSamplerAddPin(PHOTO_SENSOR_PIN, PHOTO_SENSOR_FILTER, onPhotoSensorReading);
+    adcSamplerSetup(PHOTO_SENSOR_INTERVAL_MS);
+}
 
-    // analog setup:
-    adcAttachPin(PHOTO_SENSOR_PIN);
-
-    // analog read, not sure if this is necessary???
-    int value = analogRead(PHOTO_SENSOR_PIN);
+/**
+ * Flipping the switch either way sets the sunroom lights to match it
+ */
+void onLightSwitchEdge(const DigitalInputEvent &event)
+{
+    int switchV = event.level;
+    bool sunroomV = isRelayOn(readRelayState(), SUNROOM_LIGHTS_RELAY);
+    if (switchV == 1 && sunroomV == 0)
+    {
+        turnOnRelay(SUNROOM_LIGHTS_RELAY);
+    }
+    else if (switchV == 0 && sunroomV == 1)
+    {
+        turnOffRelay(SUNROOM_LIGHTS_RELAY);
+    }
+    IS_SWITCH_ON = switchV;
+    publishSensorEvent(SENSOR_LIGHT_SWITCH, IS_SWITCH_ON);
 }
 
 void lightSwitchSetup()
 {
-    pinMode(LIGHT_SWITCH_PIN, INPUT);
-    IS_SWITCH_ON = digitalRead(LIGHT_SWITCH_PIN);
+    int input = addDigitalInput(LIGHT_SWITCH_PIN, INPUT, LIGHT_SWITCH_DEBOUNCE_MS, onLightSwitchEdge);
+    IS_SWITCH_ON = input >= 0 ? readDigitalInput(input) : digitalRead(LIGHT_SWITCH_PIN);
 }
 
-void peripheralControlsSetup()
+void ruleSweepLoop()
 {
-    setupRelays();
-    photoSensorSetup();
-    lightSwitchSetup();
+    FREE_HEAP = ESP.getFreeHeap();
+    LOG_INFO("Free heap: %u", FREE_HEAP);
+    processRelayRules();
 }
 
-void lightSwitchLoop()
+void peripheralControlsSetup()
 {
-    int switchV = digitalRead(LIGHT_SWITCH_PIN);
-    if (switchV != IS_SWITCH_ON)
+    sensorEventsSetup();
+    deviceCommandsSetup();
+    relayOutputsSetup();
+    setRelayStagger(RELAY_STAGGER_MS);
+    for (int i = 0; i < RELAY_COUNT; i++)
     {
-        bool sunroomV = isRelayOn(RELAY_VALUES[SUNROOM_LIGHTS_RELAY]);
-        if (switchV == 1 && sunroomV == 0)
-        {
-            turnOnRelay(SUNROOM_LIGHTS_RELAY);
-        }
-        else if (switchV == 0 && sunroomV == 1)
-        {
-            turnOffRelay(SUNROOM_LIGHTS_RELAY);
-        }
-        IS_SWITCH_ON = switchV;
+        setRelayTiming(i, i == SUNROOM_LIGHTS_RELAY ? LIGHTS_RELAY_TIMING : RELAY_TIMING);
     }
+    photoSensorSetup();
+    lightSwitchSetup();
+    ruleSchedulerSetup();
+    addPeriodicJob("rule-sweep", RULE_SWEEP_INTERVAL_MS, ruleSweepLoop);
+    publishDeviceState();
 }
 
 /**
- * Controls the peripherals based on the current temperature and humidity
+ * Runs after every scheduler pass, applies whatever the jobs and the web server queued
+ * and drives the relays from the result
  */
 void controlPeripheralsLoop()
 {
-    lightSwitchLoop();
+    processDigitalInputs();
+    processDeviceCommands();
+    processSensorEvents();
     relayRefresh();
-    if (!timer.isIntervalPassed())
-    {
-        return;
-    }
-
-    Serial.println("Free heap:");
-    FREE_HEAP = ESP.getFreeHeap();
-    Serial.println(FREE_HEAP);
-    LIGHT_LEVEL = analogRead(PHOTO_SENSOR_PIN);
-    processRelayRules();
+    publishDeviceState();
 }
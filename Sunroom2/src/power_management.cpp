@@ -0,0 +1,77 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include "power_management.h"
+#include "job_scheduler.h"
+#include "logger.h"
+
+constexpr uint32_t MAX_CPU_FREQ_MHZ = 240;
+// the lowest frequency that keeps the APB clock, and with it the uart and wifi, at 80MHz
+constexpr uint32_t MIN_CPU_FREQ_MHZ = 80;
+
+// ESP32 datasheet, modem sleep (cpu running, radio off) and light sleep currents
+constexpr float ACTIVE_CURRENT_MA = 50;
+constexpr float IDLE_CURRENT_MA = 30;
+constexpr float IDLE_SCALED_CURRENT_MA = 20;
+constexpr float LIGHT_SLEEP_CURRENT_MA = 0.8;
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+typedef esp_pm_config_esp32s3_t PowerConfig;
+#else
+typedef esp_pm_config_esp32_t PowerConfig;
+#endif
+
+static bool frequencyScaling = false;
+static bool lightSleep = false;
+
+void powerManagementSetup()
+{
+    PowerConfig config = {};
+    config.max_freq_mhz = MAX_CPU_FREQ_MHZ;
+    config.min_freq_mhz = MIN_CPU_FREQ_MHZ;
+    config.light_sleep_enable = true;
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK)
+    {
+        // builds without tickless idle refuse light sleep, frequency scaling still helps
+        LOG_WARN("Light sleep unavailable: %s", esp_err_to_name(err));
+        config.light_sleep_enable = false;
+        err = esp_pm_configure(&config);
+    }
+    if (err != ESP_OK)
+    {
+        LOG_WARN("Power management unavailable: %s", esp_err_to_name(err));
+        return;
+    }
+    frequencyScaling = true;
+    lightSleep = config.light_sleep_enable;
+    esp_sleep_enable_gpio_wakeup();
+    LOG_INFO("Power management on, %u-%u MHz, light sleep %d", MIN_CPU_FREQ_MHZ, MAX_CPU_FREQ_MHZ, lightSleep);
+}
+
+PowerInfo getPowerInfo()
+{
+    PowerInfo info;
+    info.frequencyScaling = frequencyScaling;
+    info.lightSleep = lightSleep;
+    info.minFreqMhz = frequencyScaling ? MIN_CPU_FREQ_MHZ : MAX_CPU_FREQ_MHZ;
+    info.maxFreqMhz = MAX_CPU_FREQ_MHZ;
+    info.cpuFreqMhz = getCpuFrequencyMhz();
+    info.radioAlwaysOn = (WiFi.getMode() & WIFI_AP) != 0;
+
+    JobSchedulerStats stats = getJobSchedulerStats();
+    float total = stats.asleepMs + stats.awakeMs;
+    float asleep = total > 0 ? stats.asleepMs / total : 0;
+    float waitingCurrent = IDLE_CURRENT_MA;
+    if (lightSleep && !info.radioAlwaysOn)
+    {
+        waitingCurrent = LIGHT_SLEEP_CURRENT_MA;
+    }
+    else if (frequencyScaling)
+    {
+        waitingCurrent = IDLE_SCALED_CURRENT_MA;
+    }
+    info.estimatedCurrentMa = (1 - asleep) * ACTIVE_CURRENT_MA + asleep * waitingCurrent;
+    return info;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Lets the chip clock down and light sleep while the loop waits in runJobScheduler.
+ * FreeRTOS goes tickless when every task is blocked, so the time between jobs is spent asleep
+ * and anything that should wake the loop early has to be an interrupt, e.g. a digital input
+ * (see digital_inputs), an esp_timer or wifi traffic.
+ */
+void powerManagementSetup();
+
+struct PowerInfo
+{
+    /**
+     * What esp_pm_configure accepted, light sleep also needs a tickless idle build
+     */
+    bool frequencyScaling;
+    bool lightSleep;
+    uint32_t minFreqMhz;
+    uint32_t maxFreqMhz;
+    uint32_t cpuFreqMhz;
+    /**
+     * The soft AP keeps the radio listening, which blocks light sleep and dwarfs the cpu's draw
+     */
+    bool radioAlwaysOn;
+    /**
+     * Average draw of the chip without the radio, from the scheduler's asleep/awake split
+     * and datasheet figures, in mA
+     */
+    float estimatedCurrentMa;
+};
+
+PowerInfo getPowerInfo();
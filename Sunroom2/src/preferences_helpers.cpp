@@ -1,29 +1,350 @@
 #include <Preferences.h>
+#include <vector>
+#include <esp_rom_crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "definitions.h"
+#include "rule_helpers.h"
+#include "logger.h"
+#include "job_scheduler.h"
+#include "preferences_helpers.h"
+#include "relay_state.h"
+
+// Writes made within this long of each other share one NVS write
+constexpr unsigned long PREFERENCE_FLUSH_DELAY_MS = 500;
+
+/**
+ * The settings are one blob, written alternately to two keys. A write that is cut short
+ * leaves a slot that fails its crc and the other slot still holds the previous settings.
+ */
+constexpr uint32_t SETTINGS_MAGIC = 0x53455453; // "SETS"
+constexpr uint16_t SETTINGS_VERSION = 2;
+constexpr int SETTINGS_SLOT_COUNT = 2;
+static const char *SETTINGS_SLOTS[SETTINGS_SLOT_COUNT] = {"cfgA", "cfgB"};
 
 Preferences preferences;
 
+struct SettingsHeader
+{
+    uint32_t magic;
+    /**
+     * Layout of the payload, older layouts are read and written back as the current one
+     */
+    uint16_t version;
+    uint16_t reserved;
+    /**
+     * Bumped by every write, the valid slot with the higher one is current
+     */
+    uint32_t sequence;
+    uint32_t length;
+    /**
+     * crc32 of the header (with this field 0) and the payload
+     */
+    uint32_t crc;
+};
+
+/**
+ * Everything persisted except the reset counter, which changes every boot and keeps its
+ * own small key so booting doesn't rewrite the whole blob
+ */
+struct Settings
+{
+    String ssid;
+    String password;
+    float desiredTemperature;
+    float temperatureRange;
+    float desiredHumidity;
+    float humidityRange;
+    bool useNaturalLightingCycle;
+    int32_t turnLightsOnAtMinute;
+    int32_t turnLightsOffAtMinute;
+    RelayValue relayValues[RELAY_COUNT];
+    String relayRules[RELAY_COUNT];
+    String relayLabels[RELAY_COUNT];
+    String timezone;
+    TimezoneSource timezoneSource;
+};
+
+/**
+ * What the NVS holds, or will once the pending flush runs
+ */
+static Settings settings;
+static bool settingsDirty = false;
+static int activeSlot = -1;
+static uint32_t activeSequence = 0;
+
+static SemaphoreHandle_t preferenceMutex = nullptr;
+static int flushJob = NO_JOB;
+static bool flushPending = false;
+static PreferenceStats preferenceStats = {};
+
+static void lockPreferences()
+{
+    if (preferenceMutex != nullptr)
+    {
+        xSemaphoreTake(preferenceMutex, portMAX_DELAY);
+    }
+}
+
+static void unlockPreferences()
+{
+    if (preferenceMutex != nullptr)
+    {
+        xSemaphoreGive(preferenceMutex);
+    }
+}
+
+/**
+ * Payload encoding, values are stored as they are in memory (little endian) and
+ * strings as a 16 bit length followed by the bytes
+ */
+static void putBytes(std::vector<uint8_t> &out, const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+template <typename T>
+static void putValue(std::vector<uint8_t> &out, T value)
+{
+    putBytes(out, &value, sizeof(T));
+}
+
+static void putText(std::vector<uint8_t> &out, const String &text)
+{
+    uint16_t length = min(text.length(), 0xffffu);
+    putValue(out, length);
+    putBytes(out, text.c_str(), length);
+}
+
+struct SettingsReader
+{
+    const uint8_t *data;
+    size_t size;
+    size_t at;
+    /**
+     * Cleared by a read past the end, everything read after that is zero
+     */
+    bool ok;
+
+    void getBytes(void *out, size_t count)
+    {
+        if (!ok || size - at < count)
+        {
+            ok = false;
+            memset(out, 0, count);
+            return;
+        }
+        memcpy(out, data + at, count);
+        at += count;
+    }
+
+    template <typename T>
+    T getValue()
+    {
+        T value;
+        getBytes(&value, sizeof(T));
+        return value;
+    }
+
+    String getText()
+    {
+        uint16_t length = getValue<uint16_t>();
+        if (!ok || size - at < length)
+        {
+            ok = false;
+            return String();
+        }
+        String text = String(reinterpret_cast<const char *>(data + at), length);
+        at += length;
+        return text;
+    }
+};
+
+static void encodeSettings(const Settings &from, std::vector<uint8_t> &out)
+{
+    putText(out, from.ssid);
+    putText(out, from.password);
+    putValue(out, from.desiredTemperature);
+    putValue(out, from.temperatureRange);
+    putValue(out, from.desiredHumidity);
+    putValue(out, from.humidityRange);
+    putValue<uint8_t>(out, from.useNaturalLightingCycle);
+    putValue(out, from.turnLightsOnAtMinute);
+    putValue(out, from.turnLightsOffAtMinute);
+    putValue<uint8_t>(out, RELAY_COUNT);
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        putValue<uint8_t>(out, from.relayValues[i]);
+        putText(out, from.relayRules[i]);
+        putText(out, from.relayLabels[i]);
+    }
+    putText(out, from.timezone);
+    putValue<uint8_t>(out, from.timezoneSource);
+}
+
+static bool decodeSettingsV1(SettingsReader &reader, Settings &to)
+{
+    to.ssid = reader.getText();
+    to.password = reader.getText();
+    to.desiredTemperature = reader.getValue<float>();
+    to.temperatureRange = reader.getValue<float>();
+    to.desiredHumidity = reader.getValue<float>();
+    to.humidityRange = reader.getValue<float>();
+    to.useNaturalLightingCycle = reader.getValue<uint8_t>() != 0;
+    to.turnLightsOnAtMinute = reader.getValue<int32_t>();
+    to.turnLightsOffAtMinute = reader.getValue<int32_t>();
+    // relays the blob has and this build doesn't are dropped, missing ones keep their defaults
+    int relays = reader.getValue<uint8_t>();
+    for (int i = 0; i < relays && reader.ok; i++)
+    {
+        RelayValue value = static_cast<RelayValue>(reader.getValue<uint8_t>());
+        String rule = reader.getText();
+        String label = reader.getText();
+        if (i < RELAY_COUNT)
+        {
+            to.relayValues[i] = value;
+            to.relayRules[i] = rule;
+            to.relayLabels[i] = label;
+        }
+    }
+    return reader.ok;
+}
+
+/**
+ * Version 2 added the timezone after everything version 1 has
+ */
+static bool decodeSettingsV2(SettingsReader &reader, Settings &to)
+{
+    if (!decodeSettingsV1(reader, to))
+    {
+        return false;
+    }
+    to.timezone = reader.getText();
+    to.timezoneSource = static_cast<TimezoneSource>(reader.getValue<uint8_t>());
+    return reader.ok;
+}
+
+static uint32_t settingsCrc(SettingsHeader header, const uint8_t *payload)
+{
+    header.crc = 0;
+    uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+    return esp_rom_crc32_le(crc, payload, header.length);
+}
+
+/**
+ * Read one slot into to, returns false if it is missing, corrupt or from a newer firmware
+ */
+static bool loadSettingsSlot(int slot, Settings &to, SettingsHeader &header)
+{
+    size_t size = preferences.getBytesLength(SETTINGS_SLOTS[slot]);
+    if (size < sizeof(SettingsHeader))
+    {
+        return false;
+    }
+    std::vector<uint8_t> blob(size);
+    if (preferences.getBytes(SETTINGS_SLOTS[slot], blob.data(), size) != size)
+    {
+        return false;
+    }
+    memcpy(&header, blob.data(), sizeof(header));
+    const uint8_t *payload = blob.data() + sizeof(header);
+    if (header.magic != SETTINGS_MAGIC || header.length != size - sizeof(header) || header.crc != settingsCrc(header, payload))
+    {
+        LOG_WARN("settings slot %s is corrupt", SETTINGS_SLOTS[slot]);
+        return false;
+    }
+
+    SettingsReader reader = {payload, header.length, 0, true};
+    switch (header.version)
+    {
+    case 1:
+        return decodeSettingsV1(reader, to);
+    case 2:
+        return decodeSettingsV2(reader, to);
+    default:
+        LOG_WARN("settings slot %s has unknown version %u", SETTINGS_SLOTS[slot], header.version);
+        return false;
+    }
+}
+
 /**
- * Writes a preference to the NVS
+ * Write settings to the slot that isn't current, only then does it become current
  */
-void writePreference(const char *key, char *value)
+static bool storeSettings()
 {
-    preferences.begin("app", false);   // Start the NVS "my-app" namespace
-    preferences.putString(key, value); // Store a string
-    preferences.end();                 // End the NVS session
-    Serial.println("wrote preference: " + String(key) + " = " + String(value));
+    std::vector<uint8_t> blob(sizeof(SettingsHeader));
+    encodeSettings(settings, blob);
+
+    SettingsHeader header = {SETTINGS_MAGIC, SETTINGS_VERSION, 0, activeSequence + 1, static_cast<uint32_t>(blob.size() - sizeof(SettingsHeader)), 0};
+    header.crc = settingsCrc(header, blob.data() + sizeof(header));
+    memcpy(blob.data(), &header, sizeof(header));
+
+    int slot = activeSlot == 0 ? 1 : 0;
+    preferences.begin("app", false);
+    bool stored = preferences.putBytes(SETTINGS_SLOTS[slot], blob.data(), blob.size()) == blob.size();
+    preferences.end();
+    if (!stored)
+    {
+        LOG_ERROR("failed to write settings slot %s", SETTINGS_SLOTS[slot]);
+        return false;
+    }
+    activeSlot = slot;
+    activeSequence = header.sequence;
+    preferenceStats.flashWrites++;
+    LOG_DEBUG("wrote settings %u to %s, %u bytes", activeSequence, SETTINGS_SLOTS[slot], blob.size());
+    return true;
+}
+
+void flushPreferences()
+{
+    lockPreferences();
+    flushPending = false;
+    if (settingsDirty && storeSettings())
+    {
+        settingsDirty = false;
+        preferenceStats.flushes++;
+    }
+    unlockPreferences();
 }
 
 /**
- * Reads a preference from the NVS
+ * Change one setting, returns whether it differs from what it was
  */
-String readPreference(const char *key, const char *defaultValue)
+template <typename T>
+static bool updateSetting(T &setting, const T &value)
 {
-    preferences.begin("app", false);                         // Start the NVS "my-app" namespace
-    String value = preferences.getString(key, defaultValue); // Get the string, return "default" if it doesn't exist
-    preferences.end();                                       // End the NVS session
-    Serial.println("read preference: " + String(key) + " = " + String(value));
-    return value;
+    preferenceStats.writes++;
+    if (setting == value)
+    {
+        preferenceStats.writesAvoided++;
+        return false;
+    }
+    // a change made before the pending flush shares its write
+    if (settingsDirty)
+    {
+        preferenceStats.writesAvoided++;
+    }
+    setting = value;
+    settingsDirty = true;
+    return true;
+}
+
+/**
+ * Flush PREFERENCE_FLUSH_DELAY_MS after the first change, only call from the loop task
+ */
+static void scheduleFlush()
+{
+    if (settingsDirty && !flushPending && flushJob != NO_JOB)
+    {
+        flushPending = true;
+        scheduleJob(flushJob, PREFERENCE_FLUSH_DELAY_MS);
+    }
+}
+
+PreferenceStats getPreferenceStats()
+{
+    return preferenceStats;
 }
 
 /**
@@ -31,79 +352,217 @@ String readPreference(const char *key, const char *defaultValue)
  */
 void writeWifiCredentials(String ssid, String password)
 {
-    writePreference("ssid", (char *)ssid.c_str());
-    writePreference("pass", (char *)password.c_str());
+    // called from the web server right before a restart, so write them now
+    lockPreferences();
+    updateSetting(settings.ssid, ssid);
+    updateSetting(settings.password, password);
+    unlockPreferences();
+    flushPreferences();
 }
 /**
  * Writes the desired temperature/humidity to the NVS
  */
 void writeEnvironmentalControlValues(float temperature, float temperatureRange, float humidity, float humidityRange, bool useNaturalLightingCycle, int turnLightsOnAtMinute, int turnLightsOffAtMinute)
 {
-    writePreference("dt", (char *)String(temperature).c_str());
-    writePreference("tr", (char *)String(temperatureRange).c_str());
-    writePreference("dh", (char *)String(humidity).c_str());
-    writePreference("hr", (char *)String(humidityRange).c_str());
-    writePreference("unlc", (char *)String(useNaturalLightingCycle ? 1 : 0).c_str());
-    writePreference("tloonam", (char *)String(turnLightsOnAtMinute).c_str());
-    writePreference("tloffam", (char *)String(turnLightsOffAtMinute).c_str());
+    lockPreferences();
+    updateSetting(settings.desiredTemperature, temperature);
+    updateSetting(settings.temperatureRange, temperatureRange);
+    updateSetting(settings.desiredHumidity, humidity);
+    updateSetting(settings.humidityRange, humidityRange);
+    updateSetting(settings.useNaturalLightingCycle, useNaturalLightingCycle);
+    updateSetting(settings.turnLightsOnAtMinute, static_cast<int32_t>(turnLightsOnAtMinute));
+    updateSetting(settings.turnLightsOffAtMinute, static_cast<int32_t>(turnLightsOffAtMinute));
+    unlockPreferences();
+    scheduleFlush();
 }
 
 void writeRelayValues()
 {
+    lockPreferences();
     for (int i = 0; i < RELAY_COUNT; i++)
     {
-        writePreference(("rly" + String(i)).c_str(), (char *)String(RELAY_VALUES[i]).c_str());
+        updateSetting(settings.relayValues[i], unpackRelayValue(readRelayState(), i));
     }
+    unlockPreferences();
+    scheduleFlush();
+}
+
+void writeTimezone()
+{
+    lockPreferences();
+    updateSetting(settings.timezone, TIMEZONE);
+    updateSetting(settings.timezoneSource, TIMEZONE_SOURCE);
+    unlockPreferences();
+    scheduleFlush();
 }
 
 void writeRelayRules()
 {
+    lockPreferences();
     for (int i = 0; i < RELAY_COUNT; i++)
     {
-        writePreference(("rlyrl" + String(i)).c_str(), (char *)(RELAY_RULES[i]).c_str());
+        updateSetting(settings.relayRules[i], RELAY_RULES[i]);
     }
+    unlockPreferences();
+    scheduleFlush();
 }
 
 void writeRelayLabels()
 {
+    lockPreferences();
     for (int i = 0; i < RELAY_COUNT; i++)
     {
-        writePreference(("rlylbl" + String(i)).c_str(), (char *)(RELAY_LABELS[i]).c_str());
+        updateSetting(settings.relayLabels[i], RELAY_LABELS[i]);
     }
+    unlockPreferences();
+    scheduleFlush();
 }
 
-void setupRelay()
+/**
+ * The string keys settings were kept under before the settings blob
+ */
+static const char *LEGACY_KEYS[] = {"ssid", "pass", "dt", "tr", "dh", "hr", "unlc", "tloonam", "tloffam"};
+static const char *LEGACY_RELAY_KEYS[] = {"rly", "rlyrl", "rlylbl"};
+
+static void setDefaultSettings(Settings &to)
 {
+    to.desiredTemperature = 0;
+    to.temperatureRange = 0;
+    to.desiredHumidity = 0;
+    to.humidityRange = 0;
+    to.useNaturalLightingCycle = false;
+    to.turnLightsOnAtMinute = 0;
+    to.turnLightsOffAtMinute = 0;
     for (int i = 0; i < RELAY_COUNT; i++)
     {
-        RELAY_VALUES[i] = static_cast<RelayValue>(readPreference(("rly" + String(i)).c_str(), "0").toInt());
+        to.relayValues[i] = FORCE_OFF_AUTO_OFF;
         /**
          * Rules are json blobs that define the conditions for a relay to be turned on or off
          */
-        RELAY_RULES[i] = readPreference(("rlyrl" + String(i)).c_str(), "[\"NOP\"]");
-
+        to.relayRules[i] = "[\"NOP\"]";
         /**
          * Labels are the names of the relays
          */
-        RELAY_LABELS[i] = readPreference(("rlylbl" + String(i)).c_str(), (char *)("Relay " + String(i)).c_str());
+        to.relayLabels[i] = "Relay " + String(i);
     }
+    to.timezone = "";
+    to.timezoneSource = TIMEZONE_DEFAULT;
 }
+
+/**
+ * Read the settings from the string keys older firmware wrote, returns false if there are none
+ */
+static bool loadLegacySettings(Settings &to)
+{
+    if (!preferences.isKey("dt") && !preferences.isKey("rly0"))
+    {
+        return false;
+    }
+    to.ssid = preferences.getString("ssid", "");
+    to.password = preferences.getString("pass", "");
+    to.desiredTemperature = preferences.getString("dt", "0").toFloat();
+    to.temperatureRange = preferences.getString("tr", "0").toFloat();
+    to.desiredHumidity = preferences.getString("dh", "0").toFloat();
+    to.humidityRange = preferences.getString("hr", "0").toFloat();
+    to.useNaturalLightingCycle = preferences.getString("unlc", "0").toInt() == 1;
+    to.turnLightsOnAtMinute = preferences.getString("tloonam", "0").toInt();
+    to.turnLightsOffAtMinute = preferences.getString("tloffam", "0").toInt();
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        to.relayValues[i] = static_cast<RelayValue>(preferences.getString(("rly" + String(i)).c_str(), "0").toInt());
+        to.relayRules[i] = preferences.getString(("rlyrl" + String(i)).c_str(), to.relayRules[i]);
+        to.relayLabels[i] = preferences.getString(("rlylbl" + String(i)).c_str(), to.relayLabels[i]);
+    }
+    return true;
+}
+
+static void removeLegacySettings()
+{
+    preferences.begin("app", false);
+    for (const char *key : LEGACY_KEYS)
+    {
+        preferences.remove(key);
+    }
+    for (const char *prefix : LEGACY_RELAY_KEYS)
+    {
+        for (int i = 0; i < RELAY_COUNT; i++)
+        {
+            preferences.remove((prefix + String(i)).c_str());
+        }
+    }
+    preferences.end();
+}
+
+/**
+ * Load the newest valid slot, or migrate the legacy keys into a new blob
+ */
+static void loadSettings()
+{
+    setDefaultSettings(settings);
+    activeSlot = -1;
+    activeSequence = 0;
+    preferences.begin("app", true);
+    SettingsHeader header;
+    for (int slot = 0; slot < SETTINGS_SLOT_COUNT; slot++)
+    {
+        Settings loaded = settings;
+        if (loadSettingsSlot(slot, loaded, header) && (activeSlot < 0 || static_cast<int32_t>(header.sequence - activeSequence) > 0))
+        {
+            settings = loaded;
+            activeSlot = slot;
+            activeSequence = header.sequence;
+        }
+    }
+    bool migrate = activeSlot < 0 && loadLegacySettings(settings);
+    RESET_COUNTER = preferences.getString("resets", "0").toInt();
+    preferences.end();
+
+    if (migrate)
+    {
+        LOG_INFO("migrating settings from the legacy keys");
+        settingsDirty = true;
+        flushPreferences();
+        if (!settingsDirty)
+        {
+            removeLegacySettings();
+        }
+    }
+}
+
 void setupPreferences()
 {
-    SSID = readPreference("ssid", "");
-    PASSWORD = readPreference("pass", "");
-    DESIRED_TEMPERATURE = readPreference("dt", "0").toFloat();
-    TEMPERATURE_RANGE = readPreference("tr", "0").toFloat();
-    DESIRED_HUMIDITY = readPreference("dh", "0").toFloat();
-    HUMIDITY_RANGE = readPreference("hr", "0").toFloat();
-    USE_NATURAL_LIGHTING_CYCLE = readPreference("unlc", "0").toInt() == 1;
-    TURN_LIGHTS_ON_AT_MINUTE = readPreference("tloonam", "0").toInt();
-    TURN_LIGHTS_OFF_AT_MINUTE = readPreference("tloffam", "0").toInt();
+    preferenceMutex = xSemaphoreCreateMutex();
+    unsigned long start = micros();
+    loadSettings();
 
-    setupRelay();
+    SSID = settings.ssid;
+    PASSWORD = settings.password;
+    DESIRED_TEMPERATURE = settings.desiredTemperature;
+    TEMPERATURE_RANGE = settings.temperatureRange;
+    DESIRED_HUMIDITY = settings.desiredHumidity;
+    HUMIDITY_RANGE = settings.humidityRange;
+    USE_NATURAL_LIGHTING_CYCLE = settings.useNaturalLightingCycle;
+    TURN_LIGHTS_ON_AT_MINUTE = settings.turnLightsOnAtMinute;
+    TURN_LIGHTS_OFF_AT_MINUTE = settings.turnLightsOffAtMinute;
+    TIMEZONE = settings.timezone;
+    TIMEZONE_SOURCE = settings.timezoneSource;
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        setRelayValue(i, settings.relayValues[i]);
+        RELAY_RULES[i] = settings.relayRules[i];
+        RELAY_LABELS[i] = settings.relayLabels[i];
+    }
+    preferenceStats.loadUs = micros() - start;
 
-    RESET_COUNTER = readPreference("resets", "0").toInt();
-    writePreference("resets", (char *)String(RESET_COUNTER + 1).c_str());
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        setRelayRule(i, RELAY_RULES[i]);
+    }
+
+    // stored before anything else can crash, and outside the blob since it changes every boot
+    preferences.begin("app", false);
+    preferences.putString("resets", String(RESET_COUNTER + 1));
+    preferences.end();
 
     // if desired temperature/humidity is not valid (bad float/0), set it to default values of 23c and 60%
     if (DESIRED_TEMPERATURE <= 0 || DESIRED_HUMIDITY <= 0)
@@ -123,5 +582,9 @@ void setupPreferences()
             USE_NATURAL_LIGHTING_CYCLE,
             TURN_LIGHTS_ON_AT_MINUTE,
             TURN_LIGHTS_OFF_AT_MINUTE);
+        flushPreferences();
     }
-}
\ No newline at end of file
+
+    flushJob = addOneShotJob("preferences", flushPreferences, PREFERENCE_FLUSH_DELAY_MS);
+    flushPending = true;
+}
@@ -1,8 +1,44 @@
 #pragma once
+#include <Arduino.h>
+
+struct PreferenceStats
+{
+    /**
+     * Settings changes asked for, and how many of those didn't cost a write of their own because
+     * the value was unchanged or a write was already pending
+     */
+    uint32_t writes;
+    uint32_t writesAvoided;
+    /**
+     * Settings blobs written
+     */
+    uint32_t flashWrites;
+    uint32_t flushes;
+    /**
+     * How long setupPreferences took to load the settings at boot, in us
+     */
+    uint32_t loadUs;
+};
 
 void writeWifiCredentials(String ssid, String password);
 void writeEnvironmentalControlValues(float temperature, float temperatureRange, float humidity, float humidityRange, bool useNaturalLightingCycle, int turnLightsOnAtMinute, int turnLightsOffAtMinute);
 void setupPreferences();
+
+/**
+ * These only write if a value changed, and only half a second later so a burst of
+ * changes shares one write of the settings blob. Only call from the loop task.
+ */
 void writeRelayValues();
 void writeRelayRules();
 void writeRelayLabels();
+void writeTimezone();
+
+/**
+ * Write every pending change to the NVS now, safe to call from any task
+ */
+void flushPreferences();
+
+/**
+ * Safe to call from any task, the counters can be a write apart
+ */
+PreferenceStats getPreferenceStats();
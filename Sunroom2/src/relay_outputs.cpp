@@ -0,0 +1,266 @@
+#include <Arduino.h>
+#include <soc/soc.h>
+#include <soc/gpio_reg.h>
+#include "relay_outputs.h"
+#include "job_scheduler.h"
+
+static_assert(RELAY_COUNT <= 32, "relay states are bits of a uint32_t");
+
+/**
+ * Register bits of each relay's pin, pins 32 and up are in the second bank of registers
+ */
+static uint32_t LOW_BANK_MASKS[RELAY_COUNT];
+static uint32_t HIGH_BANK_MASKS[RELAY_COUNT];
+
+static uint32_t desired = 0;
+static uint32_t applied = 0;
+static RelayOutputStats stats = {};
+
+static RelayTiming TIMINGS[RELAY_COUNT] = {};
+static uint32_t staggerMs = 0;
+
+/**
+ * When each relay last switched, only for the relays in switchedMask. The ones that haven't
+ * switched since boot have no minimum time to wait out.
+ */
+static uint32_t SWITCHED_AT[RELAY_COUNT];
+static uint32_t switchedMask = 0;
+static uint32_t lastSwitchMs = 0;
+
+static RelayTransition PENDING[RELAY_COUNT];
+static uint32_t pendingMask = 0;
+
+static int relayJob = NO_JOB;
+
+void relayOutputsSetup()
+{
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        int pin = RELAY_PINS[i];
+        LOW_BANK_MASKS[i] = pin < 32 ? 1UL << pin : 0;
+        HIGH_BANK_MASKS[i] = pin < 32 ? 0 : 1UL << (pin - 32);
+        pinMode(pin, OUTPUT);
+        // the relays are active low
+        digitalWrite(pin, HIGH);
+    }
+    desired = 0;
+    applied = 0;
+    relayJob = addOneShotJob("relays", applyRelayOutputs, 0);
+}
+
+void setRelayTiming(int relay, RelayTiming timing)
+{
+    if (relay >= 0 && relay < RELAY_COUNT)
+    {
+        TIMINGS[relay] = timing;
+    }
+}
+
+void setRelayStagger(uint32_t ms)
+{
+    staggerMs = ms;
+}
+
+void setRelayOutput(int relay, bool on)
+{
+    if (on)
+    {
+        desired |= 1UL << relay;
+    }
+    else
+    {
+        desired &= ~(1UL << relay);
+    }
+}
+
+void setRelayOutputs(uint32_t on)
+{
+    desired = on & ((1UL << RELAY_COUNT) - 1);
+}
+
+uint32_t getRelayOutputs()
+{
+    return desired;
+}
+
+/**
+ * a is before b, safe across millis() wrapping
+ */
+static bool isBefore(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+/**
+ * Decide which of the changed relays switch now, the others become pending transitions.
+ * Returns the relays to switch.
+ */
+static uint32_t scheduleTransitions(uint32_t changed, uint32_t now)
+{
+    uint32_t previouslyPending = pendingMask;
+    pendingMask = 0;
+
+    // when each relay may switch as far as its own minimum time goes, sorted earliest first
+    int order[RELAY_COUNT];
+    uint32_t due[RELAY_COUNT];
+    RelayWait wait[RELAY_COUNT];
+    int count = 0;
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        uint32_t bit = 1UL << i;
+        if (!(changed & bit))
+        {
+            continue;
+        }
+        due[i] = now;
+        wait[i] = RELAY_WAIT_NONE;
+        if (switchedMask & bit)
+        {
+            bool on = applied & bit;
+            uint32_t minimum = on ? TIMINGS[i].minOnMs : TIMINGS[i].minOffMs;
+            uint32_t elapsed = now - SWITCHED_AT[i];
+            if (elapsed < minimum)
+            {
+                due[i] = now + (minimum - elapsed);
+                wait[i] = on ? RELAY_WAIT_MIN_ON : RELAY_WAIT_MIN_OFF;
+            }
+        }
+        int at = count++;
+        while (at > 0 && isBefore(due[i], due[order[at - 1]]))
+        {
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = i;
+    }
+
+    // then at most one staggered relay per stagger, in that order
+    uint32_t slot = now;
+    if (staggerMs > 0 && switchedMask != 0 && now - lastSwitchMs < staggerMs)
+    {
+        slot = lastSwitchMs + staggerMs;
+    }
+    for (int k = 0; k < count; k++)
+    {
+        // the unstaggered relays go first, a staggered one due now waits a stagger after them
+        int i = order[k];
+        if (staggerMs > 0 && !TIMINGS[i].staggered && !isBefore(now, due[i]))
+        {
+            slot = now + staggerMs;
+        }
+    }
+    uint32_t switching = 0;
+    for (int k = 0; k < count; k++)
+    {
+        int i = order[k];
+        uint32_t bit = 1UL << i;
+        if (staggerMs > 0 && TIMINGS[i].staggered)
+        {
+            if (isBefore(due[i], slot))
+            {
+                due[i] = slot;
+                wait[i] = RELAY_WAIT_STAGGER;
+            }
+            slot = due[i] + staggerMs;
+        }
+        if (!isBefore(now, due[i]))
+        {
+            switching |= bit;
+            continue;
+        }
+        PENDING[i] = {static_cast<bool>(desired & bit), due[i], wait[i]};
+        pendingMask |= bit;
+        if (!(previouslyPending & bit))
+        {
+            stats.deferred++;
+        }
+    }
+
+    // a pending relay that was changed back before its transition was due
+    stats.cancelled += __builtin_popcount(previouslyPending & ~changed);
+
+    if (pendingMask != 0 && relayJob != NO_JOB)
+    {
+        uint32_t next = 0;
+        bool found = false;
+        for (int i = 0; i < RELAY_COUNT; i++)
+        {
+            if ((pendingMask & (1UL << i)) && (!found || isBefore(PENDING[i].dueMs, next)))
+            {
+                next = PENDING[i].dueMs;
+                found = true;
+            }
+        }
+        scheduleJob(relayJob, next - now);
+    }
+    return switching;
+}
+
+void applyRelayOutputs()
+{
+    uint32_t now = millis();
+    uint32_t changed = scheduleTransitions(desired ^ applied, now);
+    if (changed == 0)
+    {
+        stats.skipped++;
+        return;
+    }
+
+    uint32_t set = 0, clear = 0, highSet = 0, highClear = 0;
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        if (!(changed & (1UL << i)))
+        {
+            continue;
+        }
+        stats.switches[i]++;
+        SWITCHED_AT[i] = now;
+        // on is low
+        if (desired & (1UL << i))
+        {
+            clear |= LOW_BANK_MASKS[i];
+            highClear |= HIGH_BANK_MASKS[i];
+        }
+        else
+        {
+            set |= LOW_BANK_MASKS[i];
+            highSet |= HIGH_BANK_MASKS[i];
+        }
+    }
+    // the write-1-to-set/clear registers only touch the pins whose bits are set
+    if (set != 0)
+    {
+        REG_WRITE(GPIO_OUT_W1TS_REG, set);
+    }
+    if (clear != 0)
+    {
+        REG_WRITE(GPIO_OUT_W1TC_REG, clear);
+    }
+    if (highSet != 0)
+    {
+        REG_WRITE(GPIO_OUT1_W1TS_REG, highSet);
+    }
+    if (highClear != 0)
+    {
+        REG_WRITE(GPIO_OUT1_W1TC_REG, highClear);
+    }
+    applied ^= changed;
+    switchedMask |= changed;
+    lastSwitchMs = now;
+    stats.writes++;
+}
+
+uint32_t getPendingRelayTransitions(RelayTransition (&transitions)[RELAY_COUNT])
+{
+    uint32_t mask = pendingMask;
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        transitions[i] = PENDING[i];
+    }
+    return mask;
+}
+
+RelayOutputStats getRelayOutputStats()
+{
+    return stats;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <Arduino.h>
+#include "definitions.h"
+
+/**
+ * The relay pins. Changes only go into a bitmask of the relays that should be on, applying
+ * writes the relays whose bit differs from what the pins were last set to, in a single write
+ * to the gpio set and clear registers. Applying with nothing changed doesn't touch the pins.
+ *
+ * A relay that switched stays that way for at least its minimum on or off time, and no two
+ * staggered relays switch closer together than the stagger. A relay that isn't staggered
+ * switches as soon as its own minimum allows, the staggered ones keep the stagger from it. A change that has to wait becomes the
+ * relay's pending transition and a job applies it when it is due. Each relay has at most one,
+ * a newer change replaces it and changing back before it is due drops it, so a rule hovering
+ * around a threshold doesn't chatter the relay.
+ *
+ * Only call these from the loop task, except the getters marked otherwise.
+ */
+
+struct RelayTiming
+{
+    /**
+     * How long the relay stays on or off after switching before it can switch back, in ms
+     */
+    uint32_t minOnMs;
+    uint32_t minOffMs;
+    /**
+     * Waits its turn in the stagger, leave it off for a relay someone is waiting on
+     */
+    bool staggered;
+};
+
+enum RelayWait : uint8_t
+{
+    RELAY_WAIT_NONE = 0,
+    RELAY_WAIT_MIN_ON = 1,
+    RELAY_WAIT_MIN_OFF = 2,
+    /**
+     * Another relay switched or is due to switch less than the stagger before it
+     */
+    RELAY_WAIT_STAGGER = 3,
+};
+
+struct RelayTransition
+{
+    bool on;
+    /**
+     * millis() the relay switches at
+     */
+    uint32_t dueMs;
+    RelayWait wait;
+};
+
+/**
+ * Set every relay pin up as an output with the relay off
+ */
+void relayOutputsSetup();
+
+/**
+ * Both default to 0 and not staggered, which switches everything that changed right away in
+ * one write
+ */
+void setRelayTiming(int relay, RelayTiming timing);
+void setRelayStagger(uint32_t staggerMs);
+
+void setRelayOutput(int relay, bool on);
+
+/**
+ * Set every relay at once, bit i is relay i
+ */
+void setRelayOutputs(uint32_t on);
+
+/**
+ * Bit i is set when relay i should be on
+ */
+uint32_t getRelayOutputs();
+
+/**
+ * Write whatever changed since the last apply and is due to the pins, and queue the rest
+ */
+void applyRelayOutputs();
+
+/**
+ * Bit i is set when relay i has a pending transition, which is copied into transitions[i].
+ * Safe to call from any task, a transition can be an apply apart from the mask.
+ */
+uint32_t getPendingRelayTransitions(RelayTransition (&transitions)[RELAY_COUNT]);
+
+struct RelayOutputStats
+{
+    /**
+     * Times each relay changed state on its pin
+     */
+    uint32_t switches[RELAY_COUNT];
+    /**
+     * Applies that had something to write, and the ones that didn't
+     */
+    uint32_t writes;
+    uint32_t skipped;
+    /**
+     * Changes that had to wait for a minimum time or the stagger, and pending ones dropped
+     * because the relay was changed back first
+     */
+    uint32_t deferred;
+    uint32_t cancelled;
+};
+
+/**
+ * Safe to call from any task, the counters can be an apply apart
+ */
+RelayOutputStats getRelayOutputStats();
@@ -0,0 +1,96 @@
+#include <Arduino.h>
+#include <atomic>
+#include "relay_state.h"
+
+/**
+ * Bit 0 of every relay's 4 bits
+ */
+constexpr uint32_t RELAY_LOW_BITS = 0x11111111;
+
+static std::atomic<uint32_t> RELAY_STATE{0};
+
+uint32_t relayOnMask(uint32_t state)
+{
+    // bit 0 and 1 of the force and auto field of every relay at once, each lands on bit 4 * relay
+    uint32_t force0 = state & RELAY_LOW_BITS;
+    uint32_t force1 = (state >> 1) & RELAY_LOW_BITS;
+    uint32_t auto0 = (state >> 2) & RELAY_LOW_BITS;
+    uint32_t auto1 = (state >> 3) & RELAY_LOW_BITS;
+    uint32_t forcedOn = force0 & ~force1;
+    uint32_t autoOn = force1 & ~force0 & auto0 & ~auto1;
+    uint32_t on = forcedOn | autoOn;
+
+    // squeeze bit 4 * relay down to bit relay
+    on = (on | (on >> 3)) & 0x03030303;
+    on = (on | (on >> 6)) & 0x000F000F;
+    on = (on | (on >> 12)) & 0x000000FF;
+    return on & ((1u << RELAY_COUNT) - 1);
+}
+
+uint32_t readRelayState()
+{
+    return RELAY_STATE.load();
+}
+
+/**
+ * Replace the bits in mask of one relay's 4 bits with bits
+ */
+static uint32_t updateRelayBits(int relay, uint32_t mask, uint32_t bits)
+{
+    if (relay < 0 || relay >= RELAY_COUNT)
+    {
+        return RELAY_STATE.load();
+    }
+    int shift = relay * RELAY_STATE_BITS;
+    uint32_t current = RELAY_STATE.load();
+    uint32_t next;
+    do
+    {
+        next = (current & ~(mask << shift)) | ((bits & mask) << shift);
+    } while (!RELAY_STATE.compare_exchange_weak(current, next));
+    return next;
+}
+
+static uint32_t sanitizeField(uint32_t field)
+{
+    return field <= RELAY_FIELD_X ? field : RELAY_FIELD_X;
+}
+
+uint32_t setRelayForce(int relay, uint32_t force)
+{
+    return updateRelayBits(relay, 0x3, sanitizeField(force));
+}
+
+uint32_t setRelayAuto(int relay, uint32_t autoValue)
+{
+    return updateRelayBits(relay, 0xC, sanitizeField(autoValue) << 2);
+}
+
+uint32_t setRelayValue(int relay, RelayValue value)
+{
+    return updateRelayBits(relay, RELAY_STATE_MASK, packRelayValue(value));
+}
+
+bool isValidRelayValue(long value)
+{
+    return value >= 0 && value <= FORCE_X_AUTO_X && value % 10 <= 2;
+}
+
+uint32_t packRelayValue(RelayValue value)
+{
+    int decimal = static_cast<int>(value);
+    uint32_t force = decimal >= 0 ? sanitizeField(decimal % 10) : RELAY_FIELD_X;
+    uint32_t autoValue = decimal >= 0 ? sanitizeField(decimal / 10) : RELAY_FIELD_X;
+    return force | (autoValue << 2);
+}
+
+RelayValue unpackRelayValue(uint32_t state, int relay)
+{
+    return static_cast<RelayValue>(relayAuto(state, relay) * 10 + relayForce(state, relay));
+}
+
+uint32_t withRelayValue(uint32_t state, int relay, RelayValue value)
+{
+    int shift = relay * RELAY_STATE_BITS;
+    return (state & ~(RELAY_STATE_MASK << shift)) | (packRelayValue(value) << shift);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <Arduino.h>
+#include "definitions.h"
+
+/**
+ * The force and auto values of every relay packed into one 32 bit word, 4 bits per relay:
+ * force in the low 2 bits and auto in the high 2, each RELAY_FIELD_OFF, _ON or _X.
+ * Changes go through a compare and swap on the whole word, so any task can read or update
+ * a relay without tearing the others.
+ *
+ * RelayValue (the decimal 00..22 values) stays the format of the /relays json and the saved
+ * settings, the conversions below translate at those edges.
+ */
+
+constexpr uint32_t RELAY_FIELD_OFF = 0;
+constexpr uint32_t RELAY_FIELD_ON = 1;
+constexpr uint32_t RELAY_FIELD_X = 2;
+
+constexpr int RELAY_STATE_BITS = 4;
+constexpr uint32_t RELAY_STATE_MASK = 0xF;
+
+static_assert(RELAY_COUNT * RELAY_STATE_BITS <= 32, "every relay has to fit in the state word");
+
+constexpr uint32_t relayForce(uint32_t state, int relay)
+{
+    return (state >> (relay * RELAY_STATE_BITS)) & 0x3;
+}
+
+constexpr uint32_t relayAuto(uint32_t state, int relay)
+{
+    return (state >> (relay * RELAY_STATE_BITS + 2)) & 0x3;
+}
+
+/**
+ * Bit i is set when relay i is on: forced on, or not forced and auto on
+ */
+uint32_t relayOnMask(uint32_t state);
+
+inline bool isRelayOn(uint32_t state, int relay)
+{
+    return (relayOnMask(state) >> relay) & 1;
+}
+
+/**
+ * The current word, safe to call from any task
+ */
+uint32_t readRelayState();
+
+/**
+ * Change one relay's force or auto field, or both, safe to call from any task.
+ * Returns the word after the change.
+ */
+uint32_t setRelayForce(int relay, uint32_t force);
+uint32_t setRelayAuto(int relay, uint32_t autoValue);
+uint32_t setRelayValue(int relay, RelayValue value);
+
+/**
+ * Both digits of value are 0, 1 or 2
+ */
+bool isValidRelayValue(long value);
+
+/**
+ * One relay's 4 bits from and to the decimal RelayValue, an invalid digit becomes X
+ */
+uint32_t packRelayValue(RelayValue value);
+RelayValue unpackRelayValue(uint32_t state, int relay);
+
+/**
+ * state with one relay's 4 bits replaced by value, doesn't change the shared word
+ */
+uint32_t withRelayValue(uint32_t state, int relay, RelayValue value);
@@ -0,0 +1,356 @@
+#include "rule_compiler.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <string.h>
+#include "definitions.h"
+#include "symbol_registry.h"
+#include "time_helpers.h"
+#include "logger.h"
+#include <algorithm>
+#include <math.h>
+
+struct RuleFunction
+{
+    const char *name;
+    RuleOpCode opCode;
+    int minArgs;
+    int maxArgs;
+};
+
+static const RuleFunction RULE_FUNCTIONS[] = {
+    {"NOP", OP_NOP, 0, 0},
+    // IF, AND and OR have no opcode of their own, they compile to jumps
+    {"IF", OP_JUMP_IF_FALSE, 3, 3},
+    {"AND", OP_JUMP_IF_FALSE_OR_POP, 2, UINT8_MAX},
+    {"OR", OP_JUMP_IF_TRUE_OR_POP, 2, UINT8_MAX},
+    {"SET", OP_SET, 2, 2},
+    {"NOT", OP_NOT, 1, 1},
+    {"EQ", OP_EQ, 2, 2},
+    {"NE", OP_NE, 2, 2},
+    {"GT", OP_GT, 2, 2},
+    {"LT", OP_LT, 2, 2},
+    {"GTE", OP_GTE, 2, 2},
+    {"LTE", OP_LTE, 2, 2},
+};
+
+/**
+ * Compiler state, tracks how deep the VM stack will be at the current point of the program
+ */
+struct RuleCompiler
+{
+    RuleProgram &program;
+    int depth;
+    /**
+     * currentTime references, and how many of them are in a comparison with a constant
+     */
+    int timeReads;
+    int scheduledTimeReads;
+};
+
+static void emitU16(RuleProgram &program, uint16_t value)
+{
+    program.code.push_back(value & 0xff);
+    program.code.push_back(value >> 8);
+}
+
+static void patchU16(RuleProgram &program, size_t pos, uint16_t value)
+{
+    program.code[pos] = value & 0xff;
+    program.code[pos + 1] = value >> 8;
+}
+
+/**
+ * Account for an instruction that pops `pops` values and pushes `pushes` values
+ */
+static ErrorCode adjustDepth(RuleCompiler &compiler, int pops, int pushes)
+{
+    compiler.depth += pushes - pops;
+    if (compiler.depth > RULE_STACK_SIZE)
+    {
+        return STACK_DEPTH_ERROR;
+    }
+    if (compiler.depth > compiler.program.stackDepth)
+    {
+        compiler.program.stackDepth = compiler.depth;
+    }
+    return NO_ERROR;
+}
+
+static ErrorCode emitConst(RuleCompiler &compiler, float value)
+{
+    uint8_t bytes[sizeof(float)];
+    memcpy(bytes, &value, sizeof(float));
+    compiler.program.code.push_back(OP_CONST);
+    compiler.program.code.insert(compiler.program.code.end(), bytes, bytes + sizeof(float));
+    return adjustDepth(compiler, 0, 1);
+}
+
+static ErrorCode emitSymbol(RuleCompiler &compiler, const String &name)
+{
+    RuleProgram &program = compiler.program;
+
+    int actuator = findActuatorId(name);
+    if (actuator >= 0)
+    {
+        program.code.push_back(OP_ACTUATOR);
+        program.code.push_back(static_cast<uint8_t>(actuator));
+        program.actuatorMask |= 1 << actuator;
+        return adjustDepth(compiler, 0, 1);
+    }
+
+    int sensor = findSensorId(name);
+    if (sensor >= 0)
+    {
+        program.code.push_back(OP_SENSOR);
+        program.code.push_back(static_cast<uint8_t>(sensor));
+        program.sensorMask |= 1 << sensor;
+        if (sensor == SENSOR_CURRENT_TIME)
+        {
+            compiler.timeReads++;
+        }
+        return adjustDepth(compiler, 0, 1);
+    }
+
+    // unknown names are rejected here instead of failing on every tick
+    return UNREC_STR_ERROR;
+}
+
+static bool isCurrentTime(JsonVariantConst node)
+{
+    return node.is<const char *>() && strcmp(node.as<const char *>(), getSensorName(SENSOR_CURRENT_TIME)) == 0;
+}
+
+/**
+ * Returns true and the value if node compiles to a constant
+ */
+static bool getConstant(JsonVariantConst node, float &value)
+{
+    if (node.is<const char *>())
+    {
+        const char *str = node.as<const char *>();
+        if (str[0] != '@')
+        {
+            return false;
+        }
+        value = mintuesFromHHMM(str);
+        return true;
+    }
+    if (node.is<bool>())
+    {
+        value = node.as<bool>() ? 1 : 0;
+        return true;
+    }
+    if (node.is<float>())
+    {
+        value = node.as<float>();
+        return true;
+    }
+    return false;
+}
+
+static void addTimeTransition(RuleProgram &program, int minute)
+{
+    if (minute < 0 || minute >= MINUTES_IN_DAY)
+    {
+        return;
+    }
+    program.timeTransitions.push_back(minute);
+}
+
+/**
+ * Record the minutes at which comparing currentTime with a constant can change outcome.
+ * currentTime is a whole number of minutes, so "< t" flips at ceil(t) and "> t" at floor(t) + 1,
+ * which are the same minute unless t is whole. Midnight is always one, the clock wraps there.
+ */
+static void collectTimeThreshold(RuleCompiler &compiler, JsonArrayConst comparison)
+{
+    JsonVariantConst other;
+    if (isCurrentTime(comparison[1]))
+    {
+        other = comparison[2];
+    }
+    else if (isCurrentTime(comparison[2]))
+    {
+        other = comparison[1];
+    }
+    else
+    {
+        return;
+    }
+
+    float threshold;
+    if (!getConstant(other, threshold))
+    {
+        return;
+    }
+    RuleProgram &program = compiler.program;
+    addTimeTransition(program, ceilf(threshold));
+    addTimeTransition(program, floorf(threshold) + 1);
+    addTimeTransition(program, 0);
+    compiler.scheduledTimeReads++;
+}
+
+/**
+ * recursive function to compile a rule node, mirrors processRelayRule
+ */
+static ErrorCode compileNode(RuleCompiler &compiler, JsonVariantConst node)
+{
+    RuleProgram &program = compiler.program;
+
+    if (!node.is<JsonArrayConst>())
+    {
+        if (node.is<String>())
+        {
+            String str = node.as<String>();
+            if (str.startsWith("@"))
+            {
+                return emitConst(compiler, mintuesFromHHMM(str));
+            }
+            return emitSymbol(compiler, str);
+        }
+        else if (node.is<bool>())
+        {
+            return emitConst(compiler, node.as<bool>() ? 1 : 0);
+        }
+        else if (node.is<int>())
+        {
+            return emitConst(compiler, node.as<int>());
+        }
+        else if (node.is<float>())
+        {
+            return emitConst(compiler, node.as<float>());
+        }
+        return UNREC_TYPE_ERROR;
+    }
+
+    JsonArrayConst array = node.as<JsonArrayConst>();
+    String type = array[0];
+
+    const RuleFunction *function = nullptr;
+    for (const RuleFunction &candidate : RULE_FUNCTIONS)
+    {
+        if (type == candidate.name)
+        {
+            function = &candidate;
+            break;
+        }
+    }
+    if (function == nullptr)
+    {
+        return UNREC_FUNC_ERROR;
+    }
+    int args = array.size() - 1;
+    if (args < function->minArgs || args > function->maxArgs)
+    {
+        return ARITY_ERROR;
+    }
+
+    if (function->opCode == OP_JUMP_IF_FALSE)
+    {
+        ErrorCode error = compileNode(compiler, array[1]);
+        if (error != NO_ERROR)
+        {
+            return error;
+        }
+        program.code.push_back(OP_JUMP_IF_FALSE);
+        size_t elseJumpPos = program.code.size();
+        emitU16(program, 0);
+        adjustDepth(compiler, 1, 0);
+
+        int branchDepth = compiler.depth;
+        error = compileNode(compiler, array[2]);
+        if (error != NO_ERROR)
+        {
+            return error;
+        }
+        program.code.push_back(OP_JUMP);
+        size_t endJumpPos = program.code.size();
+        emitU16(program, 0);
+
+        // only one of the branches runs, so the else branch starts from the same depth
+        size_t elseStart = program.code.size();
+        compiler.depth = branchDepth;
+        error = compileNode(compiler, array[3]);
+        if (error != NO_ERROR)
+        {
+            return error;
+        }
+
+        // jump offsets are relative to the end of the jump instruction
+        patchU16(program, elseJumpPos, elseStart - (elseJumpPos + 2));
+        patchU16(program, endJumpPos, program.code.size() - (endJumpPos + 2));
+        return NO_ERROR;
+    }
+
+    if (function->opCode == OP_JUMP_IF_FALSE_OR_POP || function->opCode == OP_JUMP_IF_TRUE_OR_POP)
+    {
+        // every operand but the last can end the AND/OR early, they all jump to the end
+        std::vector<size_t> jumpPositions;
+        for (int i = 1; i <= args; i++)
+        {
+            ErrorCode error = compileNode(compiler, array[i]);
+            if (error != NO_ERROR)
+            {
+                return error;
+            }
+            if (i == args)
+            {
+                break;
+            }
+            program.code.push_back(function->opCode);
+            jumpPositions.push_back(program.code.size());
+            emitU16(program, 0);
+            adjustDepth(compiler, 1, 0);
+        }
+        program.code.push_back(OP_BOOL);
+
+        for (size_t pos : jumpPositions)
+        {
+            patchU16(program, pos, program.code.size() - (pos + 2));
+        }
+        return NO_ERROR;
+    }
+
+    if (function->opCode >= OP_EQ && function->opCode <= OP_LTE)
+    {
+        collectTimeThreshold(compiler, array);
+    }
+
+    for (int i = 1; i <= args; i++)
+    {
+        ErrorCode error = compileNode(compiler, array[i]);
+        if (error != NO_ERROR)
+        {
+            return error;
+        }
+    }
+    program.code.push_back(function->opCode);
+    return adjustDepth(compiler, args, 1);
+}
+
+ErrorCode compileRule(const String &rule, RuleProgram &program)
+{
+    program = RuleProgram();
+
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, rule);
+    if (error)
+    {
+        LOG_WARN("deserializeJson() failed: %s", error.c_str());
+        return PARSE_ERROR;
+    }
+
+    RuleCompiler compiler = {program, 0, 0, 0};
+    ErrorCode compileError = compileNode(compiler, doc.as<JsonVariantConst>());
+    if (compileError != NO_ERROR)
+    {
+        program = RuleProgram();
+        return compileError;
+    }
+
+    std::vector<uint16_t> &transitions = program.timeTransitions;
+    std::sort(transitions.begin(), transitions.end());
+    transitions.erase(std::unique(transitions.begin(), transitions.end()), transitions.end());
+    program.timeEveryMinute = compiler.timeReads > compiler.scheduledTimeReads;
+    return NO_ERROR;
+}
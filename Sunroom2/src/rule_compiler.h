@@ -0,0 +1,115 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "rule_helpers.h"
+
+/**
+ * Max number of values on the rule VM stack. The compiler rejects any rule that
+ * would need more than this, so evaluation never recurses and never grows.
+ */
+constexpr int RULE_STACK_SIZE = 16;
+
+/**
+ * Rules are compiled once (when they are set or loaded from NVS) into a compact
+ * postfix bytecode so evaluating them never has to touch the json parser.
+ *
+ * Operands follow the opcode byte:
+ * OP_NOP                        push void
+ * OP_CONST <f32>                push a number (bools are 0/1, @HH:MM are minutes)
+ * OP_SENSOR <u8 sensor id>      push SENSOR_VALUES[id]
+ * OP_ACTUATOR <u8 relay index>  push an actuator
+ * OP_SET                        pop value and actuator, set it, push void
+ * OP_EQ/.../OP_LTE               pop b and a, push the result
+ * OP_NOT                        pop a, push the result
+ * OP_BOOL                       pop a, push a > 0 as 0/1
+ * OP_JUMP_IF_FALSE <u16 offset> pop the condition, skip ahead if it is false
+ * OP_JUMP_IF_FALSE_OR_POP <u16> if the top is false leave 0 and skip ahead, otherwise pop it
+ * OP_JUMP_IF_TRUE_OR_POP <u16>  if the top is true leave 1 and skip ahead, otherwise pop it
+ * OP_JUMP <u16 offset>          skip ahead
+ *
+ * An IF compiles to: cond JUMP_IF_FALSE(else) then JUMP(end) else
+ * An AND compiles to: a JUMP_IF_FALSE_OR_POP(end) b JUMP_IF_FALSE_OR_POP(end) ... z BOOL
+ * so operands after the first false one (first true one for OR) are never evaluated.
+ */
+enum RuleOpCode : uint8_t
+{
+    OP_NOP = 0,
+    OP_CONST = 1,
+    OP_SENSOR = 2,
+    OP_ACTUATOR = 3,
+    OP_SET = 4,
+    OP_NOT = 5,
+    OP_EQ = 6,
+    OP_NE = 7,
+    OP_GT = 8,
+    OP_LT = 9,
+    OP_GTE = 10,
+    OP_LTE = 11,
+    OP_BOOL = 12,
+    OP_JUMP_IF_FALSE = 13,
+    OP_JUMP_IF_FALSE_OR_POP = 14,
+    OP_JUMP_IF_TRUE_OR_POP = 15,
+    OP_JUMP = 16,
+};
+
+struct RuleProgram
+{
+    std::vector<uint8_t> code;
+    /**
+     * Deepest the VM stack gets while running this program
+     */
+    uint8_t stackDepth = 0;
+    /**
+     * Bit per SensorId this program reads, it only needs to run again when one of them changes
+     */
+    uint32_t sensorMask = 0;
+    /**
+     * Bit per relay this program can SET
+     */
+    uint8_t actuatorMask = 0;
+    /**
+     * Minutes of the day at which a currentTime comparison in this program can change outcome
+     */
+    std::vector<uint16_t> timeTransitions;
+    /**
+     * currentTime is used somewhere other than a comparison with a constant,
+     * so the outcome could change on any minute
+     */
+    bool timeEveryMinute = false;
+};
+
+/**
+ * A rule that has been optimized and compiled but not yet given to a relay
+ */
+struct CompiledRule
+{
+    /**
+     * Optimized json, this is what gets stored
+     */
+    String rule;
+    RuleProgram program;
+    RuleOptimization optimization;
+};
+
+/**
+ * Tagged value on the rule VM stack
+ */
+struct RuleValue
+{
+    TypeCode type;
+    union
+    {
+        float val;
+        uint8_t actuator;
+    };
+};
+
+/**
+ * Compile a json rule into bytecode, returns NO_ERROR on success
+ */
+ErrorCode compileRule(const String &rule, RuleProgram &program);
+
+/**
+ * Run a compiled rule, returns NO_ERROR and the value left on the stack on success
+ */
+ErrorCode runRuleProgram(const RuleProgram &program, RuleValue &result);
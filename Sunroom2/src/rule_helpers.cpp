@@ -1,11 +1,19 @@
 #include "rule_helpers.h"
+#include "rule_compiler.h"
+#include "rule_optimizer.h"
+#include "symbol_registry.h"
+#include "sensor_events.h"
+#include "rule_scheduler.h"
+#include "logger.h"
+#include "time_helpers.h"
+#include "relay_state.h"
 #include <Arduino.h>
 #include <time.h>
 #include "definitions.h"
-#include "interval_timer.h"
 #include <ArduinoJson.h>
 #include <map>
 #include <functional>
+#include <string.h>
 
 /**
  * This file contains the logic for processing the relay rules
@@ -36,15 +44,10 @@
  */
 void setRelay(int index, float value)
 {
-    RelayValue currentValue = RELAY_VALUES[index];
-
     int intVal = static_cast<int>(value);
 
-    // lowest (ones) tenths digit is the "force" value that we don't want to change, just update the auto value (tens digit)
-    int onesDigit = currentValue % 10;
-    int newValue = (intVal * 10) + onesDigit;
-
-    RELAY_VALUES[index] = static_cast<RelayValue>(newValue);
+    // only the auto field, the force field is the user's and stays as it is
+    setRelayAuto(index, intVal == 0 ? RELAY_FIELD_OFF : intVal == 1 ? RELAY_FIELD_ON : RELAY_FIELD_X);
 }
 
 float getTemperature()
@@ -101,6 +104,10 @@ std::map<String, float (*)()> FLOAT_SENSOR_MAP = {
     {"humidity", getHumidity},
     {"photoSensor", getPhotoSensor},
     {"lightSwitch", getLightSwitch},
+    {"probeTemperature_0", [] { return PROBE_TEMPERATURES[0]; }},
+    {"probeTemperature_1", [] { return PROBE_TEMPERATURES[1]; }},
+    {"probeTemperature_2", [] { return PROBE_TEMPERATURES[2]; }},
+    {"probeTemperature_3", [] { return PROBE_TEMPERATURES[3]; }},
 };
 
 /**
@@ -111,20 +118,6 @@ int mintuesFromHHMM(String hhmm)
     return hhmm.substring(1, 3).toInt() * 60 + hhmm.substring(4, 6).toInt();
 }
 
-/**
- * Get the current time in minutes
- */
-int getCurrentMinutes()
-{
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo))
-    {
-        Serial.println("Failed to obtain time");
-        return -1;
-    }
-    return (timeinfo.tm_hour * 60) + timeinfo.tm_min;
-}
-
 /**
  * Create a rule return value
  */
@@ -169,11 +162,39 @@ RuleReturn createBoolActuatorRuleReturn(std::function<void(int)> actuatorSetter)
     return createRuleReturn(BOOL_ACTUATOR_TYPE, NO_ERROR, 0.0, actuatorSetter);
 }
 
+/**
+ * Look up a sensor/actuator name
+ */
+RuleReturn resolveSymbol(const String &str)
+{
+    // check if in actuator map
+    auto actuator = ACTUATOR_SETTER_MAP.find(str);
+    if (actuator != ACTUATOR_SETTER_MAP.end())
+    {
+        return createBoolActuatorRuleReturn(actuator->second);
+    }
+
+    // check if in sensor map
+    auto sensor = FLOAT_SENSOR_MAP.find(str);
+    if (sensor != FLOAT_SENSOR_MAP.end())
+    {
+        return createFloatRuleReturn(sensor->second());
+    }
+
+    if (str == "currentTime")
+    {
+        return createTimeRuleReturn(getCurrentMinutes());
+    }
+
+    return createErrorRuleReturn(UNREC_STR_ERROR);
+}
+
 /**
  * recursive function to process the rules
  */
 RuleReturn processRelayRule(JsonVariantConst doc)
 {
+    RULE_NODE_VISITS++;
     RuleReturn voidReturn = createRuleReturn(VOID_TYPE, NO_ERROR, 0.0, 0);
 
     if (!doc.is<JsonArrayConst>())
@@ -186,24 +207,7 @@ RuleReturn processRelayRule(JsonVariantConst doc)
             {
                 return createTimeRuleReturn(mintuesFromHHMM(str));
             }
-            // check if in actuator map
-            if (ACTUATOR_SETTER_MAP.find(str) != ACTUATOR_SETTER_MAP.end())
-            {
-                return createBoolActuatorRuleReturn(ACTUATOR_SETTER_MAP[str]);
-            }
-
-            // check if in sensor map
-            if (FLOAT_SENSOR_MAP.find(str) != FLOAT_SENSOR_MAP.end())
-            {
-                return createFloatRuleReturn(FLOAT_SENSOR_MAP[str]());
-            }
-
-            if (str == "currentTime")
-            {
-                return createTimeRuleReturn(getCurrentMinutes());
-            }
-
-            return createErrorRuleReturn(UNREC_STR_ERROR);
+            return resolveSymbol(str);
         }
         else if (doc.is<bool>())
         {
@@ -297,10 +301,7 @@ RuleReturn processRelayRule(JsonVariantConst doc)
         float bBool = bVal > 0 ? 1 : 0;
 
         bool result = type == "AND" ? (aBool && bBool) : (aBool || bBool);
-        Serial.println("AND/OR");
-        Serial.println(aBool);
-        Serial.println(bBool);
-        Serial.println(result);
+        LOG_DEBUG("%s %d %d -> %d", type, aBool > 0, bBool > 0, result);
 
         return createBoolRuleReturn(result);
     }
@@ -367,11 +368,7 @@ RuleReturn processRelayRule(JsonVariantConst doc)
             result = aResult.val <= bResult.val;
         }
 
-        Serial.println("Comparison");
-        Serial.println(type);
-        Serial.println(aResult.val);
-        Serial.println(bResult.val);
-        Serial.println(result);
+        LOG_DEBUG("%s %f %f -> %d", type, aResult.val, bResult.val, result);
 
         return createBoolRuleReturn(result);
     }
@@ -381,61 +378,365 @@ RuleReturn processRelayRule(JsonVariantConst doc)
 
 void printRuleReturn(RuleReturn result)
 {
-    Serial.println("RuleReturn:");
-    Serial.println("\ttype: " + String(result.type));
-    Serial.println("\terrorCode: " + String(result.errorCode));
-    Serial.println("\val: " + String(result.val));
+    LOG_DEBUG("RuleReturn type: %d, errorCode: %d, val: %f", result.type, result.errorCode, result.val);
 }
 
+static RuleProgram RELAY_PROGRAMS[RELAY_COUNT];
+static RuleOptimization RELAY_RULE_OPTIMIZATIONS[RELAY_COUNT] = {};
+
 /**
- * Process the relay rules
+ * Bit per relay whose rule has to run on the next pass regardless of its inputs
  */
-void processRelayRules()
+static uint8_t DIRTY_RELAY_RULES = 0;
+
+uint32_t RULE_EVALUATIONS = 0;
+uint32_t RULE_EVALUATIONS_SKIPPED = 0;
+
+uint32_t RULE_NODE_VISITS = 0;
+
+static uint16_t readU16(const RuleProgram &program, size_t pc)
+{
+    return program.code[pc] | (program.code[pc + 1] << 8);
+}
+
+/**
+ * Run a compiled rule on a fixed size value stack.
+ * Same semantics as processRelayRule, but iterative and allocation free.
+ */
+ErrorCode runRuleProgram(const RuleProgram &program, RuleValue &result)
+{
+    RuleValue stack[RULE_STACK_SIZE];
+    int sp = 0;
+    size_t pc = 0;
+    size_t end = program.code.size();
+
+    while (pc < end)
+    {
+        RuleOpCode op = static_cast<RuleOpCode>(program.code[pc++]);
+        // counted like the json nodes: jumps are plumbing, an AND/OR counts once where it ends
+        if (op < OP_JUMP_IF_FALSE_OR_POP)
+        {
+            RULE_NODE_VISITS++;
+        }
+
+        // the compiler already checked the depth, this just guards against a corrupt program.
+        // OP_NOP..OP_ACTUATOR are the only instructions that grow the stack
+        if (op <= OP_ACTUATOR && sp >= RULE_STACK_SIZE)
+        {
+            return STACK_DEPTH_ERROR;
+        }
+
+        switch (op)
+        {
+        case OP_NOP:
+            stack[sp++].type = VOID_TYPE;
+            break;
+        case OP_CONST:
+            stack[sp].type = FLOAT_TYPE;
+            memcpy(&stack[sp].val, &program.code[pc], sizeof(float));
+            sp++;
+            pc += sizeof(float);
+            break;
+        case OP_SENSOR:
+            stack[sp].type = FLOAT_TYPE;
+            stack[sp++].val = SENSOR_VALUES[program.code[pc++]];
+            break;
+        case OP_ACTUATOR:
+            stack[sp].type = BOOL_ACTUATOR_TYPE;
+            stack[sp++].actuator = program.code[pc++];
+            break;
+        case OP_SET:
+        {
+            RuleValue &actuator = stack[sp - 2];
+            RuleValue &value = stack[sp - 1];
+            // Currently only support bool actuators
+            if (actuator.type != BOOL_ACTUATOR_TYPE || value.type != FLOAT_TYPE)
+            {
+                return BOOL_ACTUATOR_ERROR;
+            }
+            setRelay(actuator.actuator, value.val);
+            sp--;
+            stack[sp - 1].type = VOID_TYPE;
+            break;
+        }
+        case OP_NOT:
+        {
+            RuleValue &a = stack[sp - 1];
+            if (a.type != FLOAT_TYPE)
+            {
+                return NOT_ERROR;
+            }
+            a.val = a.val <= 0 ? 1 : 0;
+            break;
+        }
+        case OP_EQ:
+        case OP_NE:
+        case OP_GT:
+        case OP_LT:
+        case OP_GTE:
+        case OP_LTE:
+        {
+            RuleValue &a = stack[sp - 2];
+            RuleValue &b = stack[sp - 1];
+            if (a.type != FLOAT_TYPE || b.type != FLOAT_TYPE)
+            {
+                return COMPARISON_TYPE_EQUALITY_ERROR;
+            }
+            bool comparison;
+            switch (op)
+            {
+            case OP_EQ:
+                comparison = a.val == b.val;
+                break;
+            case OP_NE:
+                comparison = a.val != b.val;
+                break;
+            case OP_GT:
+                comparison = a.val > b.val;
+                break;
+            case OP_LT:
+                comparison = a.val < b.val;
+                break;
+            case OP_GTE:
+                comparison = a.val >= b.val;
+                break;
+            default:
+                comparison = a.val <= b.val;
+                break;
+            }
+            a.val = comparison ? 1 : 0;
+            sp--;
+            break;
+        }
+        case OP_JUMP_IF_FALSE:
+        {
+            RuleValue &condition = stack[--sp];
+            if (condition.type != FLOAT_TYPE)
+            {
+                return IF_CONDITION_ERROR;
+            }
+            pc += 2;
+            if (condition.val <= 0)
+            {
+                pc += readU16(program, pc - 2);
+            }
+            break;
+        }
+        case OP_BOOL:
+        {
+            RuleValue &a = stack[sp - 1];
+            if (a.type != FLOAT_TYPE)
+            {
+                return AND_OR_ERROR;
+            }
+            a.val = a.val > 0 ? 1 : 0;
+            break;
+        }
+        case OP_JUMP_IF_FALSE_OR_POP:
+        case OP_JUMP_IF_TRUE_OR_POP:
+        {
+            RuleValue &a = stack[sp - 1];
+            if (a.type != FLOAT_TYPE)
+            {
+                return AND_OR_ERROR;
+            }
+            bool aBool = a.val > 0;
+            pc += 2;
+            if (aBool == (op == OP_JUMP_IF_TRUE_OR_POP))
+            {
+                // short circuit, the rest of the operands are skipped
+                RULE_NODE_VISITS++;
+                a.val = aBool ? 1 : 0;
+                pc += readU16(program, pc - 2);
+            }
+            else
+            {
+                sp--;
+            }
+            break;
+        }
+        case OP_JUMP:
+            pc += 2 + readU16(program, pc);
+            break;
+        default:
+            return UNREC_FUNC_ERROR;
+        }
+    }
+
+    if (sp != 1)
+    {
+        return STACK_DEPTH_ERROR;
+    }
+    result = stack[0];
+    return NO_ERROR;
+}
+
+ErrorCode compileRelayRule(const String &rule, CompiledRule &compiled)
+{
+    ErrorCode error = optimizeRule(rule, compiled.rule, compiled.optimization);
+    if (error != NO_ERROR)
+    {
+        return error;
+    }
+
+    error = compileRule(compiled.rule, compiled.program);
+    if (error != NO_ERROR)
+    {
+        LOG_WARN("Failed to compile rule, error: %d", error);
+        return error;
+    }
+    return NO_ERROR;
+}
+
+void installRelayRule(int index, CompiledRule &&compiled)
 {
-    // // setup some test values
-    // CURRENT_TEMPERATURE = 25.0;
-    // CURRENT_HUMIDITY = 50.0;
-    // LIGHT_LEVEL = 1000;
-    // IS_SWITCH_ON = 1;
+    RELAY_RULES[index] = std::move(compiled.rule);
+    RELAY_PROGRAMS[index] = std::move(compiled.program);
+    RELAY_RULE_OPTIMIZATIONS[index] = compiled.optimization;
+    markRelayRuleDirty(index);
+    rescheduleRuleTimeTransitions();
+}
+
+ErrorCode setRelayRule(int index, const String &rule)
+{
+    CompiledRule compiled;
+    ErrorCode error = compileRelayRule(rule, compiled);
+    if (error != NO_ERROR)
+    {
+        return error;
+    }
+    installRelayRule(index, std::move(compiled));
+    return NO_ERROR;
+}
+
+int nextRuleTimeTransition(int currentMinutes)
+{
+    int next = -1;
+    int nextDelta = MINUTES_IN_DAY + 1;
+    for (const RuleProgram &program : RELAY_PROGRAMS)
+    {
+        if (!(program.sensorMask & (1 << SENSOR_CURRENT_TIME)))
+        {
+            continue;
+        }
+        if (program.timeEveryMinute)
+        {
+            return (currentMinutes + 1) % MINUTES_IN_DAY;
+        }
+        for (uint16_t minute : program.timeTransitions)
+        {
+            // a transition at the current minute already happened, the next one is tomorrow
+            int delta = (minute - currentMinutes + MINUTES_IN_DAY) % MINUTES_IN_DAY;
+            if (delta == 0)
+            {
+                delta = MINUTES_IN_DAY;
+            }
+            if (delta < nextDelta)
+            {
+                nextDelta = delta;
+                next = minute;
+            }
+        }
+    }
+    return next;
+}
+
+void markRelayRuleDirty(int index)
+{
+    DIRTY_RELAY_RULES |= 1 << index;
+}
+
+RuleOptimization getRelayRuleOptimization(int index)
+{
+    return RELAY_RULE_OPTIMIZATIONS[index];
+}
+
+/**
+ * Run the rules that read one of changedSensors, or that are dirty
+ */
+static void runRelayRules(uint32_t changedSensors)
+{
+    // relays written by the rules run so far in this pass
+    uint8_t touchedRelays = 0;
 
     for (int i = 0; i < RELAY_COUNT; i++)
     {
-        Serial.println("Processing relay rule:");
-        Serial.println(RELAY_RULES[i]);
+        const RuleProgram &program = RELAY_PROGRAMS[i];
+        uint8_t writes = program.actuatorMask | (1 << i);
+
+        // A rule only needs to run again when something it reads changed, or when it was
+        // changed itself. It also has to run when an earlier rule in this pass wrote one of
+        // the relays it writes, so the last rule to write a relay still wins like it always has.
+        bool isDirty = DIRTY_RELAY_RULES & (1 << i);
+        bool inputsChanged = program.sensorMask & changedSensors;
+        bool overwritten = writes & touchedRelays;
+        if (!isDirty && !inputsChanged && !overwritten)
+        {
+            RULE_EVALUATIONS_SKIPPED++;
+            continue;
+        }
+        DIRTY_RELAY_RULES &= ~(1 << i);
+        touchedRelays |= writes;
+        RULE_EVALUATIONS++;
+
+        LOG_DEBUG("Processing relay rule %d: %s", i, RELAY_RULES[i]);
 
         // Set the relay auto digit to dont care
         setRelay(i, 2);
 
-        // parse json
-        DynamicJsonDocument doc(1024);
-        DeserializationError error = deserializeJson(doc, RELAY_RULES[i]);
-
-        if (error)
+        if (program.code.empty())
         {
-            Serial.print(F("deserializeJson() failed: "));
-            Serial.println(error.c_str());
+            LOG_DEBUG("Rule not compiled, skipping");
             continue;
         }
 
-        RuleReturn result = processRelayRule(doc);
+        RuleValue result;
+        ErrorCode error = runRuleProgram(program, result);
 
-        if (result.type == FLOAT_TYPE)
+        if (error != NO_ERROR)
         {
-            Serial.println("Setting actuator");
-            ACTUATOR_SETTER_MAP["relay_" + String(i)](result.val);
+            LOG_WARN("Rule %d error: %d", i, error);
+        }
+        else if (result.type == FLOAT_TYPE)
+        {
+            LOG_DEBUG("Setting actuator");
+            setRelay(i, result.val);
         }
         else if (result.type != VOID_TYPE)
         {
-            Serial.println("Unexpected rule result: ");
-            printRuleReturn(result);
+            LOG_WARN("Unexpected rule result type: %d", result.type);
         }
         else
         {
-            Serial.println("Rule processed successfully");
+            LOG_DEBUG("Rule processed successfully");
         }
     }
 }
 
+void processRelayRules()
+{
+    // read every sensor once, the programs just index into the table
+    runRelayRules(refreshSensorValues());
+    // also realign the time schedule in case the clock was synced or DST changed
+    rescheduleRuleTimeTransitions();
+}
+
+void processSensorEvents()
+{
+    uint32_t changedSensors = 0;
+    SensorEvent event;
+    while (receiveSensorEvent(event))
+    {
+        changedSensors |= updateSensorValue(event.sensor, event.value);
+    }
+
+    if (changedSensors == 0 && DIRTY_RELAY_RULES == 0)
+    {
+        return;
+    }
+    runRelayRules(changedSensors);
+}
+
 // void testRule(String rule)
 // {
 //     Serial.println("Testing Rule: ");
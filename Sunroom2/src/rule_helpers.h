@@ -23,6 +23,9 @@ enum ErrorCode
     UNREC_FUNC_ERROR = 8,
     UNREC_STR_ERROR = 9,
     UNREC_ACTUATOR_ERROR = 10,
+    ARITY_ERROR = 11,
+    PARSE_ERROR = 12,
+    STACK_DEPTH_ERROR = 13,
 };
 
 struct RuleReturn
@@ -33,4 +36,78 @@ struct RuleReturn
     std::function<void(float)> actuatorSetter;
 };
 
+struct RuleOptimization
+{
+    int nodesBefore;
+    int nodesAfter;
+};
+
+/**
+ * Convert @HH:MM to minutes
+ */
+int mintuesFromHHMM(String hhmm);
+
+/**
+ * Number of rule nodes evaluated, json nodes for processRelayRule and the instructions
+ * standing for the same nodes in the VM. Only ever increases, bench/rule_bench.cpp uses it
+ * to compare evaluation cost.
+ */
+extern uint32_t RULE_NODE_VISITS;
+
+/**
+ * Reference tree walking evaluator, works directly on the parsed json.
+ * The loop runs the compiled programs instead, this is kept for comparison.
+ */
+RuleReturn processRelayRule(JsonVariantConst doc);
+
+struct CompiledRule;
+
+/**
+ * Optimize, compile and store a new rule for a relay.
+ * The rule is left untouched if it doesn't compile.
+ */
+ErrorCode setRelayRule(int index, const String &rule);
+
+/**
+ * First half of setRelayRule, doesn't touch any relay so it is safe to call from any task
+ */
+ErrorCode compileRelayRule(const String &rule, CompiledRule &compiled);
+
+/**
+ * Second half of setRelayRule, only call from the control loop
+ */
+void installRelayRule(int index, CompiledRule &&compiled);
+
+/**
+ * Node counts of the rule last set with setRelayRule, before and after optimization
+ */
+RuleOptimization getRelayRuleOptimization(int index);
+
+/**
+ * Next minute of the day (0..1439) after currentMinutes at which a rule reading currentTime
+ * could change outcome, or -1 if no rule reads currentTime
+ */
+int nextRuleTimeTransition(int currentMinutes);
+
+/**
+ * Force a relay's rule to run on the next processRelayRules, e.g. after its value was set by hand
+ */
+void markRelayRuleDirty(int index);
+
+/**
+ * Rules run and rules skipped because none of their inputs changed
+ */
+extern uint32_t RULE_EVALUATIONS;
+extern uint32_t RULE_EVALUATIONS_SKIPPED;
+
+/**
+ * Re-read every sensor and run the rules whose inputs changed since the last call.
+ * This is the periodic safety net, sensor events normally get there first.
+ */
 void processRelayRules();
+
+/**
+ * Apply the queued sensor events and run only the rules that read those sensors
+ * (plus any dirty ones). Cheap enough to call every loop.
+ */
+void processSensorEvents();
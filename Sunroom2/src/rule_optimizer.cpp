@@ -0,0 +1,262 @@
+#include "rule_optimizer.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/**
+ * What the optimizer knows about a node it has written out
+ */
+struct OptimizedNode
+{
+    bool isConst;
+    float val;
+    /**
+     * Always evaluates to 0 or 1
+     */
+    bool isBool;
+};
+
+static const char *COMPARISONS[][2] = {
+    {"EQ", "NE"},
+    {"NE", "EQ"},
+    {"GT", "LTE"},
+    {"LT", "GTE"},
+    {"GTE", "LT"},
+    {"LTE", "GT"},
+};
+
+static OptimizedNode dynamicNode(bool isBool)
+{
+    return {false, 0, isBool};
+}
+
+static OptimizedNode writeBool(JsonVariant out, bool value)
+{
+    out.set(value);
+    return {true, value ? 1.0f : 0.0f, true};
+}
+
+/**
+ * Returns the index into COMPARISONS for a function name, -1 if it isn't a comparison
+ */
+static int findComparison(const String &type)
+{
+    for (size_t i = 0; i < sizeof(COMPARISONS) / sizeof(COMPARISONS[0]); i++)
+    {
+        if (type == COMPARISONS[i][0])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool compare(int comparison, float a, float b)
+{
+    switch (comparison)
+    {
+    case 0:
+        return a == b;
+    case 1:
+        return a != b;
+    case 2:
+        return a > b;
+    case 3:
+        return a < b;
+    case 4:
+        return a >= b;
+    default:
+        return a <= b;
+    }
+}
+
+static int countNodes(JsonVariantConst node)
+{
+    if (!node.is<JsonArrayConst>())
+    {
+        return 1;
+    }
+    int count = 1;
+    JsonArrayConst array = node.as<JsonArrayConst>();
+    for (size_t i = 1; i < array.size(); i++)
+    {
+        count += countNodes(array[i]);
+    }
+    return count;
+}
+
+/**
+ * Replace out with a copy of one of its own children
+ */
+static void hoist(JsonVariant out, JsonVariantConst child)
+{
+    DynamicJsonDocument scratch(1024);
+    scratch.set(child);
+    out.set(scratch.as<JsonVariantConst>());
+}
+
+static OptimizedNode optimizeNode(JsonVariantConst in, JsonVariant out);
+
+/**
+ * AND/OR: drop operands that can't change the result, fold if one decides it
+ */
+static OptimizedNode optimizeAndOr(JsonArrayConst in, JsonVariant out, bool isAnd)
+{
+    JsonArray array = out.to<JsonArray>();
+    array.add(isAnd ? "AND" : "OR");
+
+    for (size_t i = 1; i < in.size(); i++)
+    {
+        OptimizedNode operand = optimizeNode(in[i], array.add());
+        if (!operand.isConst)
+        {
+            continue;
+        }
+        if ((operand.val > 0) != isAnd)
+        {
+            // false for AND, true for OR
+            return writeBool(out, !isAnd);
+        }
+        array.remove(array.size() - 1);
+    }
+
+    if (array.size() == 1)
+    {
+        // every operand was true for AND (false for OR)
+        return writeBool(out, isAnd);
+    }
+    if (array.size() == 2)
+    {
+        // a single operand only needs normalizing to 0/1
+        JsonVariantConst operand = array[1];
+        String type = operand.is<JsonArrayConst>() ? operand[0].as<String>() : "";
+        bool isBool = operand.is<bool>() || findComparison(type) >= 0 || type == "AND" || type == "OR" || type == "NOT";
+        if (isBool)
+        {
+            hoist(out, operand);
+        }
+        else
+        {
+            DynamicJsonDocument scratch(1024);
+            JsonArray gt = scratch.to<JsonArray>();
+            gt.add("GT");
+            gt.add(operand);
+            gt.add(0);
+            out.set(scratch.as<JsonVariantConst>());
+        }
+    }
+    return dynamicNode(true);
+}
+
+static OptimizedNode optimizeNode(JsonVariantConst in, JsonVariant out)
+{
+    if (!in.is<JsonArrayConst>())
+    {
+        out.set(in);
+        if (in.is<String>())
+        {
+            String str = in.as<String>();
+            if (str.startsWith("@"))
+            {
+                return {true, (float)mintuesFromHHMM(str), false};
+            }
+            // sensor or actuator
+            return dynamicNode(false);
+        }
+        if (in.is<bool>())
+        {
+            return {true, in.as<bool>() ? 1.0f : 0.0f, true};
+        }
+        if (in.is<float>())
+        {
+            return {true, in.as<float>(), false};
+        }
+        return dynamicNode(false);
+    }
+
+    JsonArrayConst array = in.as<JsonArrayConst>();
+    String type = array[0];
+    int comparison = findComparison(type);
+
+    if (type == "IF" && array.size() == 4)
+    {
+        DynamicJsonDocument condition(1024);
+        OptimizedNode conditionResult = optimizeNode(array[1], condition.to<JsonVariant>());
+        if (conditionResult.isConst)
+        {
+            // only the branch that can run is kept
+            return optimizeNode(array[conditionResult.val > 0 ? 2 : 3], out);
+        }
+        JsonArray result = out.to<JsonArray>();
+        result.add("IF");
+        result.add(condition.as<JsonVariantConst>());
+        optimizeNode(array[2], result.add());
+        optimizeNode(array[3], result.add());
+        return dynamicNode(false);
+    }
+    if ((type == "AND" || type == "OR") && array.size() >= 3)
+    {
+        return optimizeAndOr(array, out, type == "AND");
+    }
+    if (type == "NOT" && array.size() == 2)
+    {
+        JsonArray result = out.to<JsonArray>();
+        result.add("NOT");
+        OptimizedNode operand = optimizeNode(array[1], result.add());
+        if (operand.isConst)
+        {
+            return writeBool(out, operand.val <= 0);
+        }
+        JsonVariant inner = result[1];
+        int innerComparison = inner.is<JsonArray>() ? findComparison(inner[0].as<String>()) : -1;
+        if (innerComparison >= 0)
+        {
+            inner[0].set(COMPARISONS[innerComparison][1]);
+            hoist(out, inner);
+        }
+        return dynamicNode(true);
+    }
+    if (comparison >= 0 && array.size() == 3)
+    {
+        JsonArray result = out.to<JsonArray>();
+        result.add(COMPARISONS[comparison][0]);
+        OptimizedNode a = optimizeNode(array[1], result.add());
+        OptimizedNode b = optimizeNode(array[2], result.add());
+        if (a.isConst && b.isConst)
+        {
+            return writeBool(out, compare(comparison, a.val, b.val));
+        }
+        return dynamicNode(true);
+    }
+    if (type == "SET" && array.size() == 3)
+    {
+        JsonArray result = out.to<JsonArray>();
+        result.add("SET");
+        result.add(array[1]);
+        optimizeNode(array[2], result.add());
+        return dynamicNode(false);
+    }
+
+    // NOP, or something the compiler will reject
+    out.set(in);
+    return dynamicNode(false);
+}
+
+ErrorCode optimizeRule(const String &rule, String &optimized, RuleOptimization &stats)
+{
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, rule);
+    if (error)
+    {
+        return PARSE_ERROR;
+    }
+
+    DynamicJsonDocument result(2048);
+    optimizeNode(doc.as<JsonVariantConst>(), result.to<JsonVariant>());
+
+    stats.nodesBefore = countNodes(doc.as<JsonVariantConst>());
+    stats.nodesAfter = countNodes(result.as<JsonVariantConst>());
+
+    optimized = "";
+    serializeJson(result, optimized);
+    return NO_ERROR;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <Arduino.h>
+#include "rule_helpers.h"
+
+/**
+ * Rewrite a json rule into a smaller equivalent one:
+ * - constant subexpressions are folded (["EQ", "@12:00", "@12:00"] -> true)
+ * - IF branches that can never run are removed
+ * - AND/OR operands that can't change the result are removed
+ * - NOT of a comparison becomes the inverse comparison (["NOT", ["GT", a, b]] -> ["LTE", a, b])
+ *
+ * Nodes the optimizer doesn't understand are copied as is, the compiler reports them.
+ */
+ErrorCode optimizeRule(const String &rule, String &optimized, RuleOptimization &stats);
@@ -0,0 +1,119 @@
+#include <Arduino.h>
+#include <time.h>
+#include <limits.h>
+#include "rule_scheduler.h"
+#include "rule_helpers.h"
+#include "sensor_events.h"
+#include "time_helpers.h"
+#include "job_scheduler.h"
+
+// Anything before 2016 means the clock hasn't been set yet
+constexpr time_t MIN_VALID_TIME = 1451606400;
+constexpr time_t SECONDS_IN_DAY = 24 * 60 * 60;
+
+static bool needsReschedule = true;
+// when the schedule was computed and when it fires next
+static time_t scheduledAt = 0;
+static time_t nextTransitionAt = 0;
+static int lastPublishedMinutes = INT_MIN;
+static int ruleSchedulerJob = NO_JOB;
+
+// Retry this often while the time isn't known, and never sleep longer than this so a clock
+// that jumped (e.g. the first ntp sync) is noticed
+constexpr unsigned long RULE_SCHEDULER_RETRY_MS = 1000;
+constexpr unsigned long RULE_SCHEDULER_MAX_SLEEP_MS = 60 * 1000;
+
+/**
+ * Returns false if the event queue was full, the caller has to try again
+ */
+static bool publishCurrentTime(int minutes)
+{
+    if (minutes == lastPublishedMinutes)
+    {
+        return true;
+    }
+    if (!publishSensorEvent(SENSOR_CURRENT_TIME, minutes))
+    {
+        return false;
+    }
+    lastPublishedMinutes = minutes;
+    return true;
+}
+
+void rescheduleRuleTimeTransitions()
+{
+    needsReschedule = true;
+    scheduleJob(ruleSchedulerJob, 0);
+}
+
+static void ruleSchedulerJobLoop()
+{
+    ruleSchedulerLoop();
+    unsigned long sleepMs = msUntilNextRuleTransition();
+    if (sleepMs == 0)
+    {
+        sleepMs = RULE_SCHEDULER_RETRY_MS;
+    }
+    scheduleJob(ruleSchedulerJob, min(sleepMs, RULE_SCHEDULER_MAX_SLEEP_MS));
+}
+
+void ruleSchedulerSetup()
+{
+    ruleSchedulerJob = addOneShotJob("rule-time", ruleSchedulerJobLoop, 0);
+}
+
+void ruleSchedulerLoop()
+{
+    // reads the clock without getLocalTime, which waits when the time isn't set
+    time_t now = time(nullptr);
+    if (now < MIN_VALID_TIME)
+    {
+        // same as getCurrentMinutes when the time is unknown
+        publishCurrentTime(-1);
+        needsReschedule = true;
+        return;
+    }
+
+    // a clock that went backwards (e.g. an ntp sync) invalidates the schedule
+    if (!needsReschedule && now >= scheduledAt && now < nextTransitionAt)
+    {
+        return;
+    }
+
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    int minutes = (timeinfo.tm_hour * 60) + timeinfo.tm_min;
+    if (!publishCurrentTime(minutes))
+    {
+        // nothing else publishes currentTime, keep the schedule open so the retry does
+        needsReschedule = true;
+        return;
+    }
+
+    scheduledAt = now;
+    needsReschedule = false;
+
+    int next = nextRuleTimeTransition(minutes);
+    if (next < 0)
+    {
+        // no time rules, setting one reschedules
+        nextTransitionAt = now + SECONDS_IN_DAY;
+        return;
+    }
+    int delta = (next - minutes + MINUTES_IN_DAY) % MINUTES_IN_DAY;
+    if (delta == 0)
+    {
+        delta = MINUTES_IN_DAY;
+    }
+    nextTransitionAt = now - timeinfo.tm_sec + delta * 60;
+}
+
+unsigned long msUntilNextRuleTransition()
+{
+    time_t now = time(nullptr);
+    if (needsReschedule || now < MIN_VALID_TIME || now >= nextTransitionAt)
+    {
+        return 0;
+    }
+    return (nextTransitionAt - now) * 1000;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/**
+ * Publishes currentTime to the rule engine only at the minutes where a time rule
+ * could change outcome, instead of re-evaluating time rules on every tick.
+ */
+void ruleSchedulerLoop();
+
+/**
+ * Register the scheduler's job, it runs at each transition
+ */
+void ruleSchedulerSetup();
+
+/**
+ * Recompute the next transition right away, e.g. after a rule changed
+ */
+void rescheduleRuleTimeTransitions();
+
+/**
+ * Milliseconds until the scheduler next has work to do, the loop can sleep this long
+ */
+unsigned long msUntilNextRuleTransition();
@@ -0,0 +1,38 @@
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "sensor_events.h"
+#include "job_scheduler.h"
+
+constexpr int SENSOR_EVENT_QUEUE_LENGTH = 16;
+
+static QueueHandle_t sensorEventQueue = nullptr;
+
+void sensorEventsSetup()
+{
+    sensorEventQueue = xQueueCreate(SENSOR_EVENT_QUEUE_LENGTH, sizeof(SensorEvent));
+}
+
+bool publishSensorEvent(SensorId sensor, float value)
+{
+    if (sensorEventQueue == nullptr)
+    {
+        return false;
+    }
+    SensorEvent event = {sensor, value};
+    if (xQueueSend(sensorEventQueue, &event, 0) != pdTRUE)
+    {
+        return false;
+    }
+    wakeJobScheduler();
+    return true;
+}
+
+bool receiveSensorEvent(SensorEvent &event)
+{
+    if (sensorEventQueue == nullptr)
+    {
+        return false;
+    }
+    return xQueueReceive(sensorEventQueue, &event, 0) == pdTRUE;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "symbol_registry.h"
+
+/**
+ * A sensor producer saw a new value
+ */
+struct SensorEvent
+{
+    SensorId sensor;
+    float value;
+};
+
+void sensorEventsSetup();
+
+/**
+ * Queue a sensor change for the rule engine, safe to call from any task.
+ * Returns false if the queue is full, the periodic sweep will pick the value up instead.
+ */
+bool publishSensorEvent(SensorId sensor, float value);
+
+/**
+ * Take the next queued event without waiting, returns false if there is none
+ */
+bool receiveSensorEvent(SensorEvent &event);
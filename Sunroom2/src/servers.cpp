@@ -13,6 +13,18 @@
 #include <ESPAsyncWebServer.h>
 #include <AsyncTCP.h>
 #include "rule_helpers.h"
+#include "logger.h"
+#include "device_state.h"
+#include "device_commands.h"
+#include "rule_compiler.h"
+#include "job_scheduler.h"
+#include "power_management.h"
+#include "aht20.h"
+#include "ds18b20.h"
+#include "adc_sampler.h"
+#include "digital_inputs.h"
+#include "relay_outputs.h"
+#include "relay_state.h"
 
 bool POST_PARAM = true;
 bool GET_PARAM = false;
@@ -35,35 +47,116 @@ float cToF(float c)
     return c * 9 / 5 + 32;
 }
 
-String getRelayValues()
+/**
+ * The packed relay word as the decimal RelayValue of each relay, the format clients expect
+ */
+String getRelayValues(uint32_t relays)
 {
     std::map<String, String> relayMap;
     for (int i = 0; i < RELAY_COUNT; i++)
     {
-        relayMap["relay_" + String(i)] = String(RELAY_VALUES[i]);
+        relayMap["relay_" + String(i)] = String(unpackRelayValue(relays, i));
     }
     return buildJson(relayMap);
 }
 
 void getRelays(AsyncWebServerRequest *request)
 {
-    request->send(200, JSON_CONTENT_TYPE, getRelayValues());
+    DeviceState state = readDeviceState();
+    request->send(200, JSON_CONTENT_TYPE, getRelayValues(state.relays));
+}
+
+/**
+ * How often each relay switched, how many output passes wrote to the pins or had nothing to write,
+ * and the transitions still waiting for a minimum time or the stagger
+ */
+void getRelayStats(AsyncWebServerRequest *request)
+{
+    RelayOutputStats stats = getRelayOutputStats();
+    std::map<String, String> relayMap;
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        relayMap["relay_" + String(i)] = String(stats.switches[i]);
+    }
+    relayMap["Writes"] = String(stats.writes);
+    relayMap["Skipped"] = String(stats.skipped);
+    relayMap["Deferred"] = String(stats.deferred);
+    relayMap["Cancelled"] = String(stats.cancelled);
+
+    // each pending transition as "on in 1200ms (min_off)"
+    static const char *WAIT_NAMES[] = {"none", "min_on", "min_off", "stagger"};
+    RelayTransition transitions[RELAY_COUNT];
+    uint32_t pending = getPendingRelayTransitions(transitions);
+    uint32_t now = millis();
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        if (pending & (1UL << i))
+        {
+            const RelayTransition &transition = transitions[i];
+            int32_t inMs = static_cast<int32_t>(transition.dueMs - now);
+            relayMap["pending_" + String(i)] = String(transition.on ? "on" : "off") + " in " + String(inMs > 0 ? inMs : 0) + "ms (" + WAIT_NAMES[transition.wait] + ")";
+        }
+    }
+    request->send(200, JSON_CONTENT_TYPE, buildJson(relayMap));
+}
+
+/**
+ * Respond to a request that queued a command for the control loop.
+ * X-Command is the command's id, it has been applied once /global-info's CommandsApplied reaches it.
+ */
+void sendCommandQueued(AsyncWebServerRequest *request, uint32_t command, const String &body)
+{
+    if (command == 0)
+    {
+        request->send(503, JSON_CONTENT_TYPE, buildJson({{"Error", String("Busy, try again")}}));
+        return;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(200, JSON_CONTENT_TYPE, body);
+    response->addHeader("X-Command", String(command));
+    response->addHeader("X-State-Version", String(readDeviceState().version));
+    request->send(response);
 }
 
+/**
+ * The control loop owns the relays, this only queues the new values.
+ * Responds with the requested values on top of the current ones.
+ */
 void setRelays(AsyncWebServerRequest *request)
 {
+    // check every value before queuing any, a bad one mustn't leave the others half applied
+    RelayValue values[RELAY_COUNT];
+    uint32_t requested = 0;
     for (int i = 0; i < RELAY_COUNT; i++)
     {
         String relayParam = "relay_" + String(i);
         if (request->hasParam(relayParam, POST_PARAM))
         {
-            RELAY_VALUES[i] = static_cast<RelayValue>(request->getParam(relayParam, POST_PARAM)->value().toInt());
+            long decimal = request->getParam(relayParam, POST_PARAM)->value().toInt();
+            if (!isValidRelayValue(decimal))
+            {
+                request->send(400, PLAIN_TEXT_CONTENT_TYPE, "Invalid value for " + relayParam);
+                return;
+            }
+            values[i] = static_cast<RelayValue>(decimal);
+            requested |= 1u << i;
         }
     }
 
-    processRelayRules();
-    writeRelayValues();
-    getRelays(request);
+    if (requested == 0)
+    {
+        getRelays(request);
+        return;
+    }
+    DeviceState state = readDeviceState();
+    uint32_t command = sendSetRelayForces(requested, values);
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        if ((requested >> i) & 1)
+        {
+            state.relays = withRelayValue(state.relays, i, values[i]);
+        }
+    }
+    sendCommandQueued(request, command, getRelayValues(state.relays));
 }
 
 void handleWifiSettings(AsyncWebServerRequest *request)
@@ -129,6 +222,7 @@ void setupOTAUpdate()
             AsyncWebServerResponse *response = request->beginResponse(200, PLAIN_TEXT_CONTENT_TYPE, (Update.hasError()) ? "FAIL" : "OK");
             response->addHeader("Connection", "close");
             request->send(response);
+            flushPreferences();
             ESP.restart(); },
         [](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final)
         {
@@ -161,15 +255,27 @@ void setupOTAUpdate()
 
 void getGlobalInfo(AsyncWebServerRequest *request)
 {
+    DeviceState state = readDeviceState();
+    PreferenceStats preferenceStats = getPreferenceStats();
     // clang-format off
     request->send(200, JSON_CONTENT_TYPE,
         buildJson({
             {"ChipId", String(CHIP_ID, HEX)},
             {"ResetCounter", String(RESET_COUNTER)},
-            {"InternalTemperature", String(cToF(INTERNAL_CHIP_TEMPERATURE), 2)},
+            {"InternalTemperature", String(cToF(state.internalTemperature), 2)},
             {"CurrentTime", getLocalTimeString()},
             {"Core", String(xPortGetCoreID())},
-            {"FreeHeap", String(FREE_HEAP)}
+            {"FreeHeap", String(state.freeHeap)},
+            {"RuleEvaluations", String(state.ruleEvaluations)},
+            {"RuleEvaluationsSkipped", String(state.ruleEvaluationsSkipped)},
+            {"LogDropped", String(LOG_DROPPED)},
+            {"StateVersion", String(state.version)},
+            {"CommandsApplied", String(state.commandsApplied)},
+            {"PreferenceWrites", String(preferenceStats.writes)},
+            {"PreferenceWritesAvoided", String(preferenceStats.writesAvoided)},
+            {"PreferenceFlashWrites", String(preferenceStats.flashWrites)},
+            {"PreferenceFlushes", String(preferenceStats.flushes)},
+            {"SettingsLoadUs", String(preferenceStats.loadUs)}
         })
     );
     // clang-format on
@@ -179,20 +285,80 @@ void getGlobalInfo(AsyncWebServerRequest *request)
 void getSensorInfo(AsyncWebServerRequest *request)
 {
     Serial.println("GET /sensor-info");
+    DeviceState state = readDeviceState();
     request->send(
         200,
         JSON_CONTENT_TYPE,
-        buildJson({{"Temperature", String(cToF(CURRENT_TEMPERATURE), 2)},
-                   {"Humidity", String(CURRENT_HUMIDITY, 2)},
-                   {"ProbeTemperature", String(cToF(CURRENT_PROBE_TEMPERATURE), 2)},
-                   {"Light", String(LIGHT_LEVEL)},
-                   {"Switch", String(IS_SWITCH_ON)}}));
+        buildJson({{"Temperature", String(cToF(state.temperature), 2)},
+                   {"Humidity", String(state.humidity, 2)},
+                   {"ProbeTemperature", String(cToF(state.probeTemperature), 2)},
+                   {"Light", String(state.lightLevel)},
+                   {"Switch", String(state.switchOn)}}));
 
     Serial.println("GET /sensor-info done");
 }
 
 /**
- * Get the rules for a relay
+ * Read counts, failures and latencies of each sensor driver
+ */
+void getSensorStats(AsyncWebServerRequest *request)
+{
+    Aht20Stats aht20 = getAht20Stats();
+    Ds18b20Stats ds18b20 = getDs18b20Stats();
+    AdcSamplerStats adc = getAdcSamplerStats();
+    std::map<String, String> sensors;
+    // clang-format off
+    sensors["aht20"] = buildJson({
+        {"Reads", String(aht20.reads)},
+        {"Failures", String(aht20.failures)},
+        {"ConsecutiveFailures", String(aht20.consecutiveFailures)},
+        {"Resets", String(aht20.resets)},
+        {"LastLatencyUs", String(aht20.lastLatencyUs)},
+        {"MaxLatencyUs", String(aht20.maxLatencyUs)},
+        {"MaxBusUs", String(aht20.maxBusUs)}
+    });
+    sensors["ds18b20"] = buildJson({
+        {"Probes", String(ds18b20.probes)},
+        {"Conversions", String(ds18b20.conversions)},
+        {"Discoveries", String(ds18b20.discoveries)},
+        {"LastLatencyUs", String(ds18b20.lastLatencyUs)},
+        {"MaxLatencyUs", String(ds18b20.maxLatencyUs)},
+        {"MaxBusUs", String(ds18b20.maxBusUs)}
+    });
+    for (uint32_t i = 0; i < ds18b20.probes; i++)
+    {
+        sensors["ds18b20_" + String(i)] = buildJson({
+            {"Reads", String(ds18b20.probe[i].reads)},
+            {"Failures", String(ds18b20.probe[i].failures)},
+            {"ConsecutiveFailures", String(ds18b20.probe[i].consecutiveFailures)}
+        });
+    }
+    sensors["adc"] = buildJson({
+        {"Dma", String(adc.dma)},
+        {"Bursts", String(adc.bursts)},
+        {"Samples", String(adc.samples)},
+        {"DroppedSamples", String(adc.droppedSamples)},
+        {"LastBurstUs", String(adc.lastBurstUs)},
+        {"MaxBurstUs", String(adc.maxBurstUs)}
+    });
+    for (int i = 0; i < getDigitalInputCount(); i++)
+    {
+        DigitalInputStats input = getDigitalInputStats(i);
+        sensors["input_" + String(getDigitalInputPin(i))] = buildJson({
+            {"Interrupts", String(input.interrupts)},
+            {"Edges", String(input.edges)},
+            {"Glitches", String(input.glitches)},
+            {"Dropped", String(input.dropped)},
+            {"LastLatencyUs", String(input.lastLatencyUs)},
+            {"MaxLatencyUs", String(input.maxLatencyUs)}
+        });
+    }
+    // clang-format on
+    request->send(200, JSON_CONTENT_TYPE, buildJsonOfJson(sensors));
+}
+
+/**
+ * Get the rules for a relay, along with the rule's node count before and after it was optimized
  * call example: /rule?i=0
  */
 void getRule(AsyncWebServerRequest *request)
@@ -207,11 +373,16 @@ void getRule(AsyncWebServerRequest *request)
         request->send(404, JSON_CONTENT_TYPE, buildJson({{"Error", String("Relay not found")}}));
         return;
     }
-    request->send(200, JSON_CONTENT_TYPE, buildJson({{"v", RELAY_RULES[relay]}}));
+    RuleOptimization optimization;
+    String rule = readRelayRule(relay, optimization);
+    request->send(200, JSON_CONTENT_TYPE, buildJson({{"v", rule},
+                                                     {"nodesBefore", String(optimization.nodesBefore)},
+                                                     {"nodesAfter", String(optimization.nodesAfter)}}));
 }
 
 /**
- * Set the rules for a relay
+ * Set the rules for a relay, the rule is optimized and compiled here so errors can be
+ * reported, the control loop installs and stores it
  *
  * post example: /rule
  * formData:
@@ -234,10 +405,16 @@ void setRule(AsyncWebServerRequest *request)
         return;
     }
     String rules = request->getParam("v", POST_PARAM)->value();
-    RELAY_RULES[relay] = rules;
-    writeRelayRules();
-    processRelayRules();
-    request->send(200, JSON_CONTENT_TYPE, buildJson({{"v", RELAY_RULES[relay]}}));
+    CompiledRule compiled;
+    ErrorCode error = compileRelayRule(rules, compiled);
+    if (error != NO_ERROR)
+    {
+        request->send(400, JSON_CONTENT_TYPE, buildJson({{"Error", String("Rule failed to compile")}, {"Code", String(error)}}));
+        return;
+    }
+    String optimized = compiled.rule;
+    uint32_t command = sendSetRule(relay, std::move(compiled));
+    sendCommandQueued(request, command, buildJson({{"v", optimized}}));
 }
 
 void setRelayLabel(AsyncWebServerRequest *request)
@@ -256,9 +433,41 @@ void setRelayLabel(AsyncWebServerRequest *request)
         return;
     }
     String label = request->getParam("v", POST_PARAM)->value();
-    RELAY_LABELS[relay] = label;
-    writeRelayLabels();
-    request->send(200, JSON_CONTENT_TYPE, buildJson({{"v", RELAY_LABELS[relay]}}));
+    uint32_t command = sendSetLabel(relay, label);
+    sendCommandQueued(request, command, buildJson({{"v", label}}));
+}
+
+/**
+ * The POSIX TZ string the clock uses, where it came from and the local time with it
+ */
+void getTimezone(AsyncWebServerRequest *request)
+{
+    static const char *SOURCE_NAMES[] = {"default", "discovered", "configured"};
+    TimezoneSource source;
+    String timezone = readTimezone(source);
+    request->send(200, JSON_CONTENT_TYPE, buildJson({{"Timezone", timezone}, {"Source", String(SOURCE_NAMES[source])}, {"CurrentTime", getLocalTimeString()}}));
+}
+
+/**
+ * Set the timezone to the POSIX TZ string in "tz", e.g. "EST5EDT,M3.2.0,M11.1.0".
+ * An empty one goes back to looking it up from the ip address.
+ */
+void setTimezone(AsyncWebServerRequest *request)
+{
+    if (!request->hasParam("tz", POST_PARAM))
+    {
+        request->send(404, JSON_CONTENT_TYPE, buildJson({{"Error", String("Timezone not found")}}));
+        return;
+    }
+    String timezone = request->getParam("tz", POST_PARAM)->value();
+    timezone.trim();
+    if (!timezone.isEmpty() && !isValidTimezone(timezone))
+    {
+        request->send(400, JSON_CONTENT_TYPE, buildJson({{"Error", String("Not a POSIX TZ string")}}));
+        return;
+    }
+    uint32_t command = sendSetTimezone(timezone, false);
+    sendCommandQueued(request, command, buildJson({{"Timezone", timezone}}));
 }
 
 void getRelayLabels(AsyncWebServerRequest *request)
@@ -266,17 +475,79 @@ void getRelayLabels(AsyncWebServerRequest *request)
     std::map<String, String> relayMap;
     for (int i = 0; i < RELAY_COUNT; i++)
     {
-        relayMap["relay_" + String(i)] = RELAY_LABELS[i];
+        relayMap["relay_" + String(i)] = readRelayLabel(i);
     }
 
     request->send(200, JSON_CONTENT_TYPE, buildJson(relayMap));
 }
 
+/**
+ * Recent log records in the binary format, decode with log_decoder.py:
+ * python3 log_decoder.py http://barn.local/logs
+ */
+void getLogs(AsyncWebServerRequest *request)
+{
+    AsyncResponseStream *response = request->beginResponseStream("application/octet-stream");
+    writeLogDump(*response);
+    request->send(response);
+}
+
+/**
+ * Run counts, lateness and run time of every scheduled job, to see which one is late and why
+ */
+void getJobs(AsyncWebServerRequest *request)
+{
+    std::map<String, String> jobs;
+    for (int i = 0; i < getJobCount(); i++)
+    {
+        JobStats stats = getJobStats(i);
+        // clang-format off
+        jobs[getJobName(i)] = buildJson({
+            {"IntervalMs", String(getJobInterval(i))},
+            {"Runs", String(stats.runs)},
+            {"Overruns", String(stats.overruns)},
+            {"LastLateMs", String(stats.lastLateMs)},
+            {"MaxLateMs", String(stats.maxLateMs)},
+            {"AvgLateMs", String(stats.runs > 0 ? (float)stats.totalLateMs / stats.runs : 0, 2)},
+            {"LastRunUs", String(stats.lastRunUs)},
+            {"MaxRunUs", String(stats.maxRunUs)}
+        });
+        // clang-format on
+    }
+    request->send(200, JSON_CONTENT_TYPE, buildJsonOfJson(jobs));
+}
+
+void getPower(AsyncWebServerRequest *request)
+{
+    PowerInfo power = getPowerInfo();
+    JobSchedulerStats stats = getJobSchedulerStats();
+    uint32_t totalMs = stats.asleepMs + stats.awakeMs;
+    // clang-format off
+    request->send(200, JSON_CONTENT_TYPE, buildJson({
+        {"FrequencyScaling", String(power.frequencyScaling)},
+        {"LightSleep", String(power.lightSleep)},
+        {"RadioAlwaysOn", String(power.radioAlwaysOn)},
+        {"MinFreqMhz", String(power.minFreqMhz)},
+        {"MaxFreqMhz", String(power.maxFreqMhz)},
+        {"CpuFreqMhz", String(power.cpuFreqMhz)},
+        {"Sleeps", String(stats.sleeps)},
+        {"EventWakes", String(stats.eventWakes)},
+        {"AsleepMs", String(stats.asleepMs)},
+        {"AwakeMs", String(stats.awakeMs)},
+        {"AsleepPercent", String(totalMs > 0 ? 100.0f * stats.asleepMs / totalMs : 0, 2)},
+        {"LastWakeLatencyUs", String(stats.lastWakeLatencyUs)},
+        {"MaxWakeLatencyUs", String(stats.maxWakeLatencyUs)},
+        {"EstimatedCurrentMa", String(power.estimatedCurrentMa, 2)}
+    }));
+    // clang-format on
+}
+
 void onReset(AsyncWebServerRequest *request)
 {
     // hardware reset
     request->send(200, JSON_CONTENT_TYPE, buildJson({{"ResetCounter", String(RESET_COUNTER)}}));
     delay(200);
+    flushPreferences();
     ESP.restart();
 }
 
@@ -291,12 +562,19 @@ void serverSetup()
     server.on("/wifi-settings", HTTP_POST, handleWifiSettings);
     server.on("/relays", HTTP_GET, getRelays);
     server.on("/relays", HTTP_POST, setRelays);
+    server.on("/relay-stats", HTTP_GET, getRelayStats);
     server.on("/sensor-info", HTTP_GET, getSensorInfo);
+    server.on("/sensor-stats", HTTP_GET, getSensorStats);
     server.on("/reset", HTTP_POST, onReset);
     server.on("/rule", HTTP_GET, getRule);
     server.on("/rule", HTTP_POST, setRule);
     server.on("/relay-labels", HTTP_GET, getRelayLabels);
     server.on("/relay-label", HTTP_POST, setRelayLabel);
+    server.on("/timezone", HTTP_GET, getTimezone);
+    server.on("/timezone", HTTP_POST, setTimezone);
+    server.on("/logs", HTTP_GET, getLogs);
+    server.on("/jobs", HTTP_GET, getJobs);
+    server.on("/power", HTTP_GET, getPower);
     setupPreactPage();
     setupOTAUpdate();
     server.onNotFound(handleNotFound);
@@ -0,0 +1,73 @@
+#include <Arduino.h>
+#include "symbol_registry.h"
+#include "definitions.h"
+
+static const char *SENSOR_NAMES[SENSOR_COUNT] = {
+    "temperature",
+    "humidity",
+    "photoSensor",
+    "lightSwitch",
+    "currentTime",
+    "probeTemperature_0",
+    "probeTemperature_1",
+    "probeTemperature_2",
+    "probeTemperature_3",
+};
+
+float SENSOR_VALUES[SENSOR_COUNT] = {};
+
+const char *getSensorName(SensorId id)
+{
+    return SENSOR_NAMES[id];
+}
+
+int findSensorId(const String &name)
+{
+    for (int i = 0; i < SENSOR_COUNT; i++)
+    {
+        if (name == SENSOR_NAMES[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int findActuatorId(const String &name)
+{
+    if (!name.startsWith("relay_") || name.length() != 7)
+    {
+        return -1;
+    }
+    int relay = name[6] - '0';
+    if (relay < 0 || relay >= RELAY_COUNT)
+    {
+        return -1;
+    }
+    return relay;
+}
+
+uint32_t updateSensorValue(SensorId id, float value)
+{
+    if (SENSOR_VALUES[id] == value)
+    {
+        return 0;
+    }
+    SENSOR_VALUES[id] = value;
+    return 1 << id;
+}
+
+uint32_t refreshSensorValues()
+{
+    uint32_t changed = 0;
+    changed |= updateSensorValue(SENSOR_TEMPERATURE, CURRENT_TEMPERATURE);
+    changed |= updateSensorValue(SENSOR_HUMIDITY, CURRENT_HUMIDITY);
+    changed |= updateSensorValue(SENSOR_PHOTO, LIGHT_LEVEL);
+    changed |= updateSensorValue(SENSOR_LIGHT_SWITCH, IS_SWITCH_ON);
+    for (int i = 0; i < MAX_PROBES; i++)
+    {
+        changed |= updateSensorValue(static_cast<SensorId>(SENSOR_PROBE_0 + i), PROBE_TEMPERATURES[i]);
+    }
+    // currentTime is published by the rule scheduler, only at the minutes a rule cares about
+    return changed;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Sensors that rules can read, rules refer to them by name and are compiled
+ * down to these ids so evaluation is just an index into SENSOR_VALUES.
+ */
+enum SensorId : uint8_t
+{
+    SENSOR_TEMPERATURE = 0,
+    SENSOR_HUMIDITY = 1,
+    SENSOR_PHOTO = 2,
+    SENSOR_LIGHT_SWITCH = 3,
+    SENSOR_CURRENT_TIME = 4,
+    /**
+     * DS18B20 probes in the order they were found on the bus, MAX_PROBES of them
+     */
+    SENSOR_PROBE_0 = 5,
+    SENSOR_PROBE_1 = 6,
+    SENSOR_PROBE_2 = 7,
+    SENSOR_PROBE_3 = 8,
+    SENSOR_COUNT = 9,
+};
+
+/**
+ * Latest value of every sensor, indexed by SensorId
+ */
+extern float SENSOR_VALUES[SENSOR_COUNT];
+
+/**
+ * Rule name of a sensor, e.g. "temperature"
+ */
+const char *getSensorName(SensorId id);
+
+/**
+ * Returns the id for a sensor name or -1 if there is no such sensor
+ */
+int findSensorId(const String &name);
+
+/**
+ * Returns the relay index for an actuator name ("relay_0".."relay_7") or -1
+ */
+int findActuatorId(const String &name);
+
+/**
+ * Store a sensor value, returns its bit if the value changed
+ */
+uint32_t updateSensorValue(SensorId id, float value);
+
+/**
+ * Copy the current sensor readings into SENSOR_VALUES.
+ * Returns a bit per SensorId whose value changed since the last refresh.
+ */
+uint32_t refreshSensorValues();
@@ -1,62 +1,37 @@
 #include <Arduino.h>
-#include <Adafruit_Sensor.h>
 #include "definitions.h"
-#include "interval_timer.h"
-#include <Adafruit_AHTX0.h>
+#include "aht20.h"
+#include "temperatureMoisture.h"
+#include "sensor_events.h"
+#include "logger.h"
 
-static Adafruit_AHTX0 aht;
+constexpr unsigned long AHT20_INTERVAL_MS = 30000;
 
-static Timer timer(30000);
-
-bool initializeSensor()
+/**
+ * Store a reading and let the rule engine know about it
+ */
+static void setReading(float temperature, float humidity)
 {
-    Serial.println("Connecting to ATH21...");
-
-    if (!aht.begin())
-    {
-        Serial.println("Could not find AHT! Check wiring.");
-        return false;
-    }
-    return true;
+    CURRENT_TEMPERATURE = temperature;
+    CURRENT_HUMIDITY = humidity;
+    publishSensorEvent(SENSOR_TEMPERATURE, CURRENT_TEMPERATURE);
+    publishSensorEvent(SENSOR_HUMIDITY, CURRENT_HUMIDITY);
 }
 
-void temperatureMoistureLoop()
+static void onAht20Reading(bool ok, float temperature, float humidity)
 {
-    if (!timer.isIntervalPassed())
-    {
-        return;
-    }
-
-    Serial.println("Main loop core: " + String(xPortGetCoreID()));
-
     INTERNAL_CHIP_TEMPERATURE = temperatureRead();
-
-    Serial.println("Checking temperature and humidity...");
-
-    // check aht status
-    if (!initializeSensor())
+    if (!ok)
     {
-        CURRENT_TEMPERATURE = NULL_TEMPERATURE;
-        CURRENT_HUMIDITY = NULL_TEMPERATURE;
+        LOG_ERROR("Could not read AHT20! Check wiring.");
+        setReading(NULL_TEMPERATURE, NULL_TEMPERATURE);
         return;
     }
-    sensors_event_t humidity, temp;
-
-    // check that we can read from the sensor
-    if (!aht.getEvent(&humidity, &temp))
-    {
-        Serial.println("Sensor read failed. Reconnecting...");
-        if (!initializeSensor())
-        {
-            CURRENT_TEMPERATURE = NULL_TEMPERATURE;
-            CURRENT_HUMIDITY = NULL_TEMPERATURE;
-            return;
-        }
-        aht.getEvent(&humidity, &temp);
-    }
-    CURRENT_TEMPERATURE = temp.temperature;
-    CURRENT_HUMIDITY = humidity.relative_humidity;
+    setReading(temperature, humidity);
+    LOG_INFO("Temperature: %.2fC, humidity: %.2f%%", CURRENT_TEMPERATURE, CURRENT_HUMIDITY);
+}
 
-    Serial.println("Temperature: " + String(CURRENT_TEMPERATURE, 2) + "C");
-    Serial.println("Humidity: " + String(CURRENT_HUMIDITY, 2) + "%");
-}
\ No newline at end of file
+void temperatureMoistureSetup()
+{
+    aht20Setup(AHT20_INTERVAL_MS, onAht20Reading);
+}
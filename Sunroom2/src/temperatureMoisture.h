@@ -1,3 +1,3 @@
 #pragma once
 
-void temperatureMoistureLoop(void);
\ No newline at end of file
+void temperatureMoistureSetup(void);
@@ -0,0 +1,40 @@
+#include <Arduino.h>
+#include "definitions.h"
+#include "ds18b20.h"
+#include "temperatureProbe.h"
+#include "sensor_events.h"
+#include "logger.h"
+
+constexpr unsigned long DS18B20_INTERVAL_MS = 30000;
+
+static_assert(DS18B20_MAX_PROBES == MAX_PROBES, "every probe the driver reads needs a sensor id");
+
+/**
+ * Store a reading and let the rule engine know about it
+ */
+static void setReading(int probe, float temperature)
+{
+    PROBE_TEMPERATURES[probe] = temperature;
+    if (probe == 0)
+    {
+        CURRENT_PROBE_TEMPERATURE = temperature;
+    }
+    publishSensorEvent(static_cast<SensorId>(SENSOR_PROBE_0 + probe), temperature);
+}
+
+static void onDs18b20Reading(int probe, bool ok, float temperature)
+{
+    if (!ok)
+    {
+        LOG_ERROR("Could not read temperature probe %d! Check wiring.", probe);
+        setReading(probe, NULL_TEMPERATURE);
+        return;
+    }
+    setReading(probe, temperature);
+    LOG_INFO("Probe %d temperature: %.2fC", probe, temperature);
+}
+
+void temperatureProbeSetup()
+{
+    ds18b20Setup(DS18B20_PIN, DS18B20_INTERVAL_MS, onDs18b20Reading);
+}
@@ -1,30 +1,92 @@
 #include <Arduino.h>
 #include <WiFi.h>
+#include <atomic>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include "time.h"
 #include "definitions.h"
-#include "interval_timer.h"
+#include "job_scheduler.h"
+#include "time_helpers.h"
+#include "device_commands.h"
+#include "rule_scheduler.h"
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
+#include "logger.h"
 
 static String WORLDTIME_API = "http://worldtimeapi.org/api/ip";
 // Refresh the time every 24 hours
-static Timer refreshTimer(24 * 60 * 60 * 1000, true);
-static Timer initializeTimer(5 * 60 * 1000, true);
-constexpr int MINUTES_IN_DAY = 24 * 60;
-
-long RAW_OFFSET = 0;
-long DST_OFFSET = 0;
+constexpr unsigned long TIME_REFRESH_INTERVAL_MS = 24 * 60 * 60 * 1000;
+constexpr unsigned long TIME_UPDATE_INTERVAL_MS = 5 * 60 * 1000;
+// The lookup runs on its own task, this only bounds how long that task can hang around
+constexpr uint16_t TIMEZONE_LOOKUP_TIMEOUT_MS = 10 * 1000;
+constexpr uint32_t TIMEZONE_TASK_STACK = 6144;
 
 bool TIME_IS_SET = false;
-bool TIMEZONE_OFFSET_IS_SET = false;
 
 /**
- * Query for the time from the internet
+ * A lookup succeeded since boot or the last refresh, and whether one is running. The lookup
+ * task sets the first, so both are atomic.
+ */
+static std::atomic<bool> timezoneLookedUp{false};
+static std::atomic<bool> timezoneLookupRunning{false};
+
+/**
+ * Rules of the common timezones with daylight saving, anywhere else gets the offset the lookup
+ * reported. Zones without daylight saving are exact that way.
+ */
+struct KnownTimezone
+{
+    const char *name;
+    const char *posix;
+};
+
+static const KnownTimezone KNOWN_TIMEZONES[] = {
+    {"America/New_York", "EST5EDT,M3.2.0,M11.1.0"},
+    {"America/Toronto", "EST5EDT,M3.2.0,M11.1.0"},
+    {"America/Detroit", "EST5EDT,M3.2.0,M11.1.0"},
+    {"America/Chicago", "CST6CDT,M3.2.0,M11.1.0"},
+    {"America/Winnipeg", "CST6CDT,M3.2.0,M11.1.0"},
+    {"America/Denver", "MST7MDT,M3.2.0,M11.1.0"},
+    {"America/Edmonton", "MST7MDT,M3.2.0,M11.1.0"},
+    {"America/Los_Angeles", "PST8PDT,M3.2.0,M11.1.0"},
+    {"America/Vancouver", "PST8PDT,M3.2.0,M11.1.0"},
+    {"America/Anchorage", "AKST9AKDT,M3.2.0,M11.1.0"},
+    {"America/Halifax", "AST4ADT,M3.2.0,M11.1.0"},
+    {"America/St_Johns", "NST3:30NDT,M3.2.0,M11.1.0"},
+    {"Europe/London", "GMT0BST,M3.5.0/1,M10.5.0"},
+    {"Europe/Dublin", "IST-1GMT0,M10.5.0,M3.5.0/1"},
+    {"Europe/Lisbon", "WET0WEST,M3.5.0/1,M10.5.0"},
+    {"Europe/Berlin", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Paris", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Amsterdam", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Madrid", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Rome", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Stockholm", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Warsaw", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Helsinki", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Athens", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Kyiv", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Australia/Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+    {"Australia/Melbourne", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+    {"Australia/Adelaide", "ACST-9:30ACDT,M10.1.0,M4.1.0/3"},
+    {"Pacific/Auckland", "NZST-12NZDT,M9.5.0,M4.1.0/3"},
+};
+
+/**
+ * Query for the time from the internet, SNTP runs in the background and sets the clock when it answers
  */
 void queryForTime()
 {
-    Serial.println("Querying for time...");
-    configTime(RAW_OFFSET, DST_OFFSET, "pool.ntp.org", "time.nist.gov");
+    LOG_INFO("Querying for time...");
+    if (TIMEZONE.isEmpty())
+    {
+        configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+    }
+    else
+    {
+        configTzTime(TIMEZONE.c_str(), "pool.ntp.org", "time.nist.gov");
+    }
 }
 
 void checkTimeIsSet()
@@ -33,13 +95,13 @@ void checkTimeIsSet()
     {
         return;
     }
-    if (time(nullptr))
+    struct tm timeinfo;
+    // getLocalTime only succeeds once the clock is past 2016, i.e. SNTP has set it
+    if (getLocalTime(&timeinfo, 0))
     {
         TIME_IS_SET = true;
-        struct tm timeinfo;
-        getLocalTime(&timeinfo); // Fix: Pass the address of timeinfo
         String timeString = String(asctime(&timeinfo));
-        Serial.println("\nTime is set: " + timeString);
+        LOG_INFO("Time is set: %s", timeString);
     }
     else
     {
@@ -47,74 +109,221 @@ void checkTimeIsSet()
     }
 }
 
-/**
- * Use the worldtimeapi.org API to get the timezone offset based on the IP address
- */
-void queryForTimezoneOffset()
+void applyTimezone()
 {
-    Serial.println("Querying for timezone offset...");
-    HTTPClient http;
-    http.begin(WORLDTIME_API);
-    int httpCode = http.GET();
+    if (TIMEZONE.isEmpty())
+    {
+        // no TZ is UTC
+        unsetenv("TZ");
+        timezoneLookedUp.store(false);
+    }
+    else
+    {
+        setenv("TZ", TIMEZONE.c_str(), 1);
+    }
+    tzset();
+    // local minutes moved, so did the time rules' next transition
+    rescheduleRuleTimeTransitions();
+    LOG_INFO("Timezone: %s (source %d)", TIMEZONE, TIMEZONE_SOURCE);
+}
 
-    if (httpCode > 0)
+static bool isTimezoneName(const char *&at)
+{
+    const char *start = at;
+    if (*at == '<')
     {
-        String payload = http.getString();
-        DynamicJsonDocument doc(1024);
-        deserializeJson(doc, payload);
+        while (*at != '\0' && *at != '>')
+        {
+            at++;
+        }
+        if (*at != '>')
+        {
+            return false;
+        }
+        at++;
+        return at - start >= 5;
+    }
+    while (isalpha(static_cast<unsigned char>(*at)))
+    {
+        at++;
+    }
+    return at - start >= 3;
+}
 
-        String timezone = doc["timezone"]; // The timezone
-        RAW_OFFSET = doc["raw_offset"];    // The raw offset in seconds
-        DST_OFFSET = doc["dst_offset"];    // The daylight savings offset in seconds
+bool isValidTimezone(const String &timezone)
+{
+    if (timezone.length() > 63)
+    {
+        return false;
+    }
+    const char *at = timezone.c_str();
+    if (!isTimezoneName(at))
+    {
+        return false;
+    }
+    if (*at == '+' || *at == '-')
+    {
+        at++;
+    }
+    if (!isdigit(static_cast<unsigned char>(*at)))
+    {
+        return false;
+    }
+    // the daylight saving part is left to the C library, only check it doesn't hold anything odd
+    for (; *at != '\0'; at++)
+    {
+        if (!isalnum(static_cast<unsigned char>(*at)) && strchr("<>+-:,./", *at) == nullptr)
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-        Serial.println("Timezone: " + timezone);
-        Serial.println("Raw offset: " + String(RAW_OFFSET));
-        Serial.println("DST offset: " + String(DST_OFFSET));
-        TIMEZONE_OFFSET_IS_SET = true;
+/**
+ * A fixed offset in POSIX form, which counts west of UTC as positive: UTC+5:30 is "<+0530>-5:30"
+ */
+static String fixedOffsetTimezone(long offsetSeconds)
+{
+    // real offsets are within UTC-12 to UTC+14, anything past 14 hours either way is a bad
+    // answer and gets clamped
+    int offsetMinutes = static_cast<int>(constrain(offsetSeconds / 60, -14L * 60, 14L * 60));
+    int minutes = abs(offsetMinutes);
+    int hours = minutes / 60;
+    minutes %= 60;
+    // sized for any int so the formatting can't be cut short
+    char name[32];
+    char offset[32];
+    snprintf(name, sizeof(name), "%c%02d%02d", offsetMinutes < 0 ? '-' : '+', hours, minutes);
+    if (minutes == 0)
+    {
+        snprintf(offset, sizeof(offset), "%s%d", offsetMinutes > 0 ? "-" : "", hours);
     }
     else
     {
-        Serial.println("Error in HTTP request");
+        snprintf(offset, sizeof(offset), "%s%d:%02d", offsetMinutes > 0 ? "-" : "", hours, minutes);
     }
-    http.end();
+    return "<" + String(name) + ">" + String(offset);
 }
 
 /**
- * Updates the time from the internet
+ * Use the worldtimeapi.org API to find the timezone of the ip address, blocks for as long as
+ * the request takes so it only runs on the lookup task
  */
-void updateTimeLoop()
+static bool queryForTimezone(String &timezone)
 {
-    if (WiFi.getMode() == WIFI_AP || WiFi.status() != WL_CONNECTED)
+    HTTPClient http;
+    http.setConnectTimeout(TIMEZONE_LOOKUP_TIMEOUT_MS);
+    http.setTimeout(TIMEZONE_LOOKUP_TIMEOUT_MS);
+    http.begin(WORLDTIME_API);
+    int httpCode = http.GET();
+    if (httpCode != 200)
     {
-        // If in AP mode or disconnected, we can't get time from the internet
-        return;
+        http.end();
+        LOG_WARN("Timezone lookup failed: %d", httpCode);
+        return false;
     }
+    String payload = http.getString();
+    http.end();
 
-    if (refreshTimer.isIntervalPassed())
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, payload);
+    if (error || !doc["raw_offset"].is<long>())
     {
-        TIME_IS_SET = false;
+        LOG_WARN("Timezone lookup returned something unexpected");
+        return false;
     }
-
-    if (!initializeTimer.isIntervalPassed())
+    String name = doc["timezone"].as<String>();
+    for (const KnownTimezone &known : KNOWN_TIMEZONES)
     {
-        return;
+        if (name == known.name)
+        {
+            timezone = known.posix;
+            return true;
+        }
     }
+    // the offset in effect right now, the daily lookup catches a daylight saving change
+    long offset = doc["raw_offset"].as<long>() + doc["dst_offset"].as<long>();
+    timezone = fixedOffsetTimezone(offset);
+    LOG_INFO("No rules for timezone %s, using %s", name, timezone);
+    return true;
+}
 
-    // We only need to query for the timezone offset once
-    if (!TIMEZONE_OFFSET_IS_SET)
+static void timezoneLookupTask(void *)
+{
+    // vTaskDelete doesn't return, so the String has to be destroyed before it
     {
-        queryForTimezoneOffset();
-        if (TIMEZONE_OFFSET_IS_SET)
+        String timezone;
+        // a failed lookup or a full command queue leaves it to the next update to try again
+        if (queryForTimezone(timezone) && sendSetTimezone(timezone, true) != 0)
         {
-            queryForTime();
-
-            // Add a little time for happy path time fetch to complete
-            delay(1000);
+            timezoneLookedUp.store(true);
         }
+    }
+    timezoneLookupRunning.store(false);
+    vTaskDelete(nullptr);
+}
+
+/**
+ * Start looking the timezone up in the background unless it was configured or already looked up
+ */
+static void startTimezoneLookup()
+{
+    if (TIMEZONE_SOURCE == TIMEZONE_CONFIGURED || timezoneLookedUp.load() || timezoneLookupRunning.load())
+    {
+        return;
+    }
+    timezoneLookupRunning.store(true);
+    if (xTaskCreate(timezoneLookupTask, "timezone", TIMEZONE_TASK_STACK, nullptr, tskIDLE_PRIORITY + 1, nullptr) != pdPASS)
+    {
+        timezoneLookupRunning.store(false);
+    }
+}
+
+/**
+ * Forget the time and the looked up timezone so the next update fetches them again
+ */
+static void refreshTime()
+{
+    TIME_IS_SET = false;
+    timezoneLookedUp.store(false);
+}
+
+void timeSetup()
+{
+    // the saved timezone applies straight away, the clock itself waits for the network
+    applyTimezone();
+    addPeriodicJob("time", TIME_UPDATE_INTERVAL_MS, updateTimeLoop);
+    addPeriodicJob("time-refresh", TIME_REFRESH_INTERVAL_MS, refreshTime, TIME_REFRESH_INTERVAL_MS);
+}
+
+/**
+ * Updates the time from the internet, nothing here waits on the network
+ */
+void updateTimeLoop()
+{
+    if (WiFi.getMode() == WIFI_AP || WiFi.status() != WL_CONNECTED)
+    {
+        // If in AP mode or disconnected, we can't get time from the internet
         return;
     }
 
     checkTimeIsSet();
+    startTimezoneLookup();
+}
+
+/**
+ * Get the current time in minutes
+ */
+int getCurrentMinutes()
+{
+    struct tm timeinfo;
+    if (!getLocalTime(&timeinfo))
+    {
+        LOG_WARN("Failed to obtain time");
+        return -1;
+    }
+    return (timeinfo.tm_hour * 60) + timeinfo.tm_min;
 }
 
 /**
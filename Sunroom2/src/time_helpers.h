@@ -2,5 +2,27 @@
 
 #pragma once
 
+constexpr int MINUTES_IN_DAY = 24 * 60;
+
+/**
+ * The clock comes from NTP and the timezone is the POSIX TZ string in TIMEZONE, so the
+ * daylight saving changes are worked out locally. It is applied at boot from the settings
+ * without waiting on the network. Unless one was set through /timezone, a background task
+ * looks the timezone up from the device's ip once a day and the result is saved.
+ */
+
+void timeSetup();
 void updateTimeLoop();
 String getLocalTimeString();
+int getCurrentMinutes();
+
+/**
+ * Start using TIMEZONE, only call from the loop task
+ */
+void applyTimezone();
+
+/**
+ * Whether timezone starts like a POSIX TZ string: a name of 3 or more letters (or <+05> style)
+ * and an offset, e.g. "UTC0", "<+0530>-5:30" or "CET-1CEST,M3.5.0,M10.5.0/3"
+ */
+bool isValidTimezone(const String &timezone);
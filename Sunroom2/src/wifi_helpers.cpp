@@ -4,7 +4,7 @@
 #include <WiFiClient.h>
 #include "definitions.h"
 #include "preferences_helpers.h"
-#include "interval_timer.h"
+#include "job_scheduler.h"
 
 #define WIFI_CONNECTION_TIMEOUT 15000
 
@@ -19,8 +19,6 @@
     WL_DISCONNECTED     = 6
 */
 
-static Timer timer(30000, false);
-
 /**
  * Connects to wifi, returns true if connected, false if not
  * Checks every 30 seconds
@@ -28,7 +26,7 @@ static Timer timer(30000, false);
 void wifiCheckInLoop()
 {
     // if wifi is down, try reconnecting every 30 seconds
-    if (!timer.isIntervalPassed() || WiFi.status() == WL_CONNECTED)
+    if (WiFi.status() == WL_CONNECTED)
     {
         return;
     }
@@ -56,4 +54,5 @@ void wifiSetup()
     {
         Serial.println("MDNS responder started. Address: " + String(WIFI_NAME) + ".local");
     }
+    addPeriodicJob("wifi", 30000, wifiCheckInLoop, 30000);
 }
\ No newline at end of file
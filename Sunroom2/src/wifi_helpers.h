@@ -1,4 +1,4 @@
 #pragma once
 
-bool wifiCheckInLoop();
+void wifiCheckInLoop();
 void wifiSetup();
\ No newline at end of file
@@ -0,0 +1,99 @@
+/**
+ * DS18B20 probes coming and going on the simulated bus, run with: pio test -e native
+ */
+#include <Arduino.h>
+#include <native_hal.h>
+#include <unity.h>
+#include "../../src/ds18b20.h"
+#include "../../src/job_scheduler.h"
+
+constexpr unsigned long PROBE_INTERVAL_MS = 1000;
+// enough for the failed reads that trigger a search and a conversion after it
+constexpr unsigned long PROBE_SETTLE_MS = 6000;
+
+struct ProbeReading
+{
+    bool ok;
+    float temperature;
+    uint32_t count;
+};
+
+static ProbeReading READINGS[DS18B20_MAX_PROBES];
+
+static void onReading(int probe, bool ok, float temperature)
+{
+    READINGS[probe] = {ok, temperature, READINGS[probe].count + 1};
+}
+
+static void runFor(unsigned long ms)
+{
+    unsigned long start = millis();
+    while (millis() - start < ms)
+    {
+        runJobScheduler(50);
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_probes_found_in_bus_order(void)
+{
+    simSetProbeCount(3);
+    simSetProbeTemperature(10, 0);
+    simSetProbeTemperature(20, 1);
+    simSetProbeTemperature(30, 2);
+    ds18b20Setup(0, PROBE_INTERVAL_MS, onReading);
+    runFor(2 * PROBE_INTERVAL_MS);
+
+    TEST_ASSERT_EQUAL(3, getDs18b20Stats().probes);
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(READINGS[i].ok);
+        TEST_ASSERT_FLOAT_WITHIN(0.01, 10 * (i + 1), READINGS[i].temperature);
+    }
+    TEST_ASSERT_EQUAL(0, READINGS[3].count);
+}
+
+static void test_lost_probe_keeps_the_others_indices(void)
+{
+    simSetProbeConnected(0, false);
+    runFor(PROBE_SETTLE_MS);
+
+    TEST_ASSERT_EQUAL(2, getDs18b20Stats().probes);
+    TEST_ASSERT_FALSE(READINGS[0].ok);
+    TEST_ASSERT_TRUE(READINGS[1].ok);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 20, READINGS[1].temperature);
+    TEST_ASSERT_TRUE(READINGS[2].ok);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 30, READINGS[2].temperature);
+}
+
+static void test_returning_probe_gets_its_index_back(void)
+{
+    simSetProbeCount(1);
+    uint32_t discoveries = getDs18b20Stats().discoveries;
+    runFor(PROBE_SETTLE_MS);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(discoveries + 1, getDs18b20Stats().discoveries);
+    TEST_ASSERT_EQUAL(1, getDs18b20Stats().probes);
+    TEST_ASSERT_TRUE(READINGS[0].ok);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 10, READINGS[0].temperature);
+    // gone probes are reported lost rather than left at their last reading
+    TEST_ASSERT_FALSE(READINGS[1].ok);
+    TEST_ASSERT_FALSE(READINGS[2].ok);
+}
+
+int main(int argc, char **argv)
+{
+    simSetSerialEnabled(false);
+    UNITY_BEGIN();
+    RUN_TEST(test_probes_found_in_bus_order);
+    RUN_TEST(test_lost_probe_keeps_the_others_indices);
+    RUN_TEST(test_returning_probe_gets_its_index_back);
+    return UNITY_END();
+}
@@ -0,0 +1,162 @@
+/**
+ * Relay switching times on the simulated pins, run with: pio test -e native
+ */
+#include <Arduino.h>
+#include <native_hal.h>
+#include <unity.h>
+#include "../../src/definitions.h"
+#include "../../src/job_scheduler.h"
+#include "../../src/relay_outputs.h"
+
+constexpr uint32_t STAGGER_MS = 100;
+constexpr uint32_t MIN_ON_MS = 400;
+constexpr uint32_t MIN_OFF_MS = 300;
+// how late a switch may come, the jobs run on the host's real clock
+constexpr uint32_t TOLERANCE_MS = 25;
+constexpr int UNSTAGGERED_RELAY = 6;
+
+/**
+ * millis() each relay's pin last changed at, and how often it changed
+ */
+static uint32_t SWITCHED_MS[RELAY_COUNT];
+static uint32_t SWITCHES[RELAY_COUNT];
+static bool PIN_ON[RELAY_COUNT];
+
+static void watchPins()
+{
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        // the relays are active low
+        bool on = simGetDigitalOutput(RELAY_PINS[i]) == LOW;
+        if (on != PIN_ON[i])
+        {
+            PIN_ON[i] = on;
+            SWITCHED_MS[i] = millis();
+            SWITCHES[i]++;
+        }
+    }
+}
+
+static void runFor(uint32_t ms)
+{
+    uint32_t start = millis();
+    while (millis() - start < ms)
+    {
+        runJobScheduler(1);
+        watchPins();
+    }
+}
+
+/**
+ * What the control loop does when rules or the switch change a relay
+ */
+static uint32_t setRelays(uint32_t on)
+{
+    setRelayOutputs(on);
+    applyRelayOutputs();
+    watchPins();
+    return millis();
+}
+
+void setUp(void)
+{
+    // start every test with everything off and long past its minimum times
+    setRelays(0);
+    runFor(MIN_ON_MS + STAGGER_MS * RELAY_COUNT);
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        SWITCHES[i] = 0;
+    }
+}
+
+void tearDown(void)
+{
+}
+
+static void test_relays_switching_together_are_staggered(void)
+{
+    uint32_t start = setRelays(0b111);
+    runFor(4 * STAGGER_MS);
+
+    TEST_ASSERT_LESS_OR_EQUAL(start + TOLERANCE_MS, SWITCHED_MS[0]);
+    for (int i = 1; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL(1, SWITCHES[i]);
+        TEST_ASSERT_GREATER_OR_EQUAL(SWITCHED_MS[i - 1] + STAGGER_MS, SWITCHED_MS[i]);
+        TEST_ASSERT_LESS_OR_EQUAL(SWITCHED_MS[i - 1] + STAGGER_MS + TOLERANCE_MS, SWITCHED_MS[i]);
+    }
+}
+
+static void test_relay_stays_on_for_its_minimum(void)
+{
+    setRelays(0b1);
+    uint32_t on = SWITCHED_MS[0];
+    setRelays(0);
+    runFor(MIN_ON_MS + TOLERANCE_MS * 2);
+
+    TEST_ASSERT_EQUAL(2, SWITCHES[0]);
+    TEST_ASSERT_GREATER_OR_EQUAL(on + MIN_ON_MS, SWITCHED_MS[0]);
+    TEST_ASSERT_LESS_OR_EQUAL(on + MIN_ON_MS + TOLERANCE_MS, SWITCHED_MS[0]);
+}
+
+static void test_relay_stays_off_for_its_minimum(void)
+{
+    setRelays(0b1);
+    runFor(MIN_ON_MS + TOLERANCE_MS);
+    setRelays(0);
+    uint32_t off = SWITCHED_MS[0];
+    setRelays(0b1);
+    runFor(MIN_OFF_MS + TOLERANCE_MS * 2);
+
+    TEST_ASSERT_EQUAL(3, SWITCHES[0]);
+    TEST_ASSERT_TRUE(PIN_ON[0]);
+    TEST_ASSERT_GREATER_OR_EQUAL(off + MIN_OFF_MS, SWITCHED_MS[0]);
+    TEST_ASSERT_LESS_OR_EQUAL(off + MIN_OFF_MS + TOLERANCE_MS, SWITCHED_MS[0]);
+}
+
+static void test_change_back_before_due_doesnt_switch(void)
+{
+    setRelays(0b1);
+    uint32_t cancelled = getRelayOutputStats().cancelled;
+    setRelays(0);
+    runFor(MIN_ON_MS / 2);
+    setRelays(0b1);
+    runFor(MIN_ON_MS);
+
+    TEST_ASSERT_EQUAL(1, SWITCHES[0]);
+    TEST_ASSERT_EQUAL(cancelled + 1, getRelayOutputStats().cancelled);
+}
+
+static void test_unstaggered_relay_switches_right_away(void)
+{
+    setRelays(0b1);
+    // inside relay 0's stagger slot, a staggered relay would wait for it
+    uint32_t pressed = setRelays(0b1 | (1 << UNSTAGGERED_RELAY));
+    TEST_ASSERT_EQUAL(1, SWITCHES[UNSTAGGERED_RELAY]);
+    TEST_ASSERT_LESS_OR_EQUAL(pressed, SWITCHED_MS[UNSTAGGERED_RELAY]);
+
+    // and a staggered relay keeps the stagger from it
+    setRelays(0b11 | (1 << UNSTAGGERED_RELAY));
+    runFor(2 * STAGGER_MS);
+    TEST_ASSERT_GREATER_OR_EQUAL(SWITCHED_MS[UNSTAGGERED_RELAY] + STAGGER_MS, SWITCHED_MS[1]);
+}
+
+int main(int argc, char **argv)
+{
+    simSetSerialEnabled(false);
+    relayOutputsSetup();
+    setRelayStagger(STAGGER_MS);
+    for (int i = 0; i < RELAY_COUNT; i++)
+    {
+        RelayTiming timing = {MIN_ON_MS, MIN_OFF_MS, true};
+        setRelayTiming(i, i == UNSTAGGERED_RELAY ? RelayTiming{0, 0, false} : timing);
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_relays_switching_together_are_staggered);
+    RUN_TEST(test_relay_stays_on_for_its_minimum);
+    RUN_TEST(test_relay_stays_off_for_its_minimum);
+    RUN_TEST(test_change_back_before_due_doesnt_switch);
+    RUN_TEST(test_unstaggered_relay_switches_right_away);
+    return UNITY_END();
+}
@@ -0,0 +1,142 @@
+/**
+ * The rule VM has to run without touching the heap, run with: pio test -e native
+ */
+#include <Arduino.h>
+#include <native_hal.h>
+#include <malloc.h>
+#include <unity.h>
+#include "../../src/definitions.h"
+#include "../../src/rule_helpers.h"
+#include "../../src/rule_compiler.h"
+#include "../../src/symbol_registry.h"
+
+/**
+ * Every heap allocation goes through malloc, including operator new, so counting here
+ * catches all of them (glibc only)
+ */
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static bool counting = false;
+static long allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    allocations += counting;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations += counting;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocations += counting;
+    return __libc_realloc(ptr, size);
+}
+
+constexpr int RUNS_PER_RULE = 100;
+
+/**
+ * Shapes the loop runs: comparisons on every sensor, n-ary AND/OR that short circuit and
+ * ones that don't, NOT, nested IF and a SET on each branch
+ */
+static const char *RULES[] = {
+    "[\"NOP\"]",
+    "[\"IF\",[\"GT\",\"temperature\",25],[\"SET\",\"relay_0\",1],[\"SET\",\"relay_0\",0]]",
+    "[\"IF\",[\"AND\",[\"GT\",\"temperature\",20],[\"LT\",\"humidity\",60],[\"EQ\",\"lightSwitch\",1]],[\"SET\",\"relay_1\",1],[\"SET\",\"relay_1\",0]]",
+    "[\"IF\",[\"OR\",[\"LT\",\"temperature\",10],[\"GT\",\"photoSensor\",1000],[\"NE\",\"humidity\",55]],[\"SET\",\"relay_2\",1],[\"SET\",\"relay_2\",0]]",
+    "[\"IF\",[\"AND\",[\"GTE\",\"currentTime\",\"@06:30\"],[\"LTE\",\"currentTime\",\"@20:00\"]],[\"SET\",\"relay_3\",1],[\"SET\",\"relay_3\",0]]",
+    "[\"IF\",[\"NOT\",[\"EQ\",\"lightSwitch\",1]],[\"SET\",\"relay_4\",1],[\"IF\",[\"GT\",\"probeTemperature_0\",30],[\"SET\",\"relay_4\",1],[\"SET\",\"relay_4\",0]]]",
+};
+
+void setUp(void)
+{
+    allocations = 0;
+}
+
+void tearDown(void)
+{
+    counting = false;
+}
+
+static void test_rules_run_without_allocating(void)
+{
+    for (const char *rule : RULES)
+    {
+        RuleProgram program;
+        TEST_ASSERT_EQUAL(NO_ERROR, compileRule(rule, program));
+
+        RuleValue result;
+        allocations = 0;
+        counting = true;
+        for (int i = 0; i < RUNS_PER_RULE; i++)
+        {
+            TEST_ASSERT_EQUAL(NO_ERROR, runRuleProgram(program, result));
+        }
+        counting = false;
+        TEST_ASSERT_EQUAL_MESSAGE(0, allocations, rule);
+    }
+}
+
+/**
+ * Each level keeps its left operand on the stack while the right one runs
+ */
+static String nestedComparison(int levels)
+{
+    String rule = "1";
+    for (int i = 0; i < levels; i++)
+    {
+        rule = "[\"EQ\",1," + rule + "]";
+    }
+    return rule;
+}
+
+static void test_too_deep_rule_is_rejected(void)
+{
+    RuleProgram program;
+    TEST_ASSERT_EQUAL(NO_ERROR, compileRule(nestedComparison(RULE_STACK_SIZE - 2), program));
+    TEST_ASSERT_EQUAL(STACK_DEPTH_ERROR, compileRule(nestedComparison(RULE_STACK_SIZE), program));
+}
+
+static void test_too_deep_program_stops_without_allocating(void)
+{
+    // a corrupt program the compiler would never emit, pushes one more constant than fits
+    RuleProgram program;
+    float one = 1;
+    for (int i = 0; i <= RULE_STACK_SIZE; i++)
+    {
+        program.code.push_back(OP_CONST);
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&one);
+        program.code.insert(program.code.end(), bytes, bytes + sizeof(one));
+    }
+
+    RuleValue result;
+    counting = true;
+    ErrorCode error = runRuleProgram(program, result);
+    counting = false;
+    TEST_ASSERT_EQUAL(STACK_DEPTH_ERROR, error);
+    TEST_ASSERT_EQUAL(0, allocations);
+}
+
+int main(int argc, char **argv)
+{
+    simSetSerialEnabled(false);
+    // fixed readings so the rules take both kinds of branch
+    CURRENT_TEMPERATURE = 27;
+    CURRENT_HUMIDITY = 55;
+    LIGHT_LEVEL = 1500;
+    IS_SWITCH_ON = 1;
+    refreshSensorValues();
+    updateSensorValue(SENSOR_CURRENT_TIME, 12 * 60);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_rules_run_without_allocating);
+    RUN_TEST(test_too_deep_rule_is_rejected);
+    RUN_TEST(test_too_deep_program_stops_without_allocating);
+    return UNITY_END();
+}